@@ -0,0 +1,387 @@
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "raylib.h"
+
+#include <fmt/core.h>
+
+#include "boid_manager.hpp"
+#include "neighbour_kernel.hpp"
+#include "trajectory_recorder.hpp"
+#include "zone_profiler.hpp"
+
+// Runs the simulation without a window and reports the cost per boid per tick
+//
+// boids_bench [--count N] [--backend update|updateThread|updateTree|
+//             updateTreeThread] [--threads N] [--ticks N] [--warmup N]
+//             [--grid] [--static] [--double-buffered] [--parallel-build]
+//             [--verlet SKIN] [--topological K] [--sweep STEPS]
+//             [--isa scalar|sse|avx2|avx512] [--sort N] [--report-locality]
+//             [--incremental N] [--approximate] [--theta X] [--trace PATH]
+//             [--seed N] [--load PATH] [--save PATH] [--record PATH]
+
+namespace {
+
+struct Options {
+    size_t Count = 5000;
+    std::string Backend = "updateTreeThread";
+    size_t Threads = 0;
+    size_t Ticks = 200;
+    size_t Warmup = 20;
+    unsigned Seed = 1;
+    bool Grid = false;
+    bool Static = false;
+    bool DoubleBuffered = false;
+    bool ParallelBuild = false;
+    float VerletSkin = 0.f;
+    size_t Topological = 0;
+    size_t SweepSteps = 0;
+    std::string Isa;
+    size_t SortInterval = 0;
+    bool ReportLocality = false;
+    size_t RebuildInterval = 0;
+    bool Approximate = false;
+    float Theta = 0.f;
+    std::string TracePath;
+    std::string LoadPath;
+    std::string SavePath;
+    std::string RecordPath;
+};
+
+void printUsage() {
+    fmt::print( "usage: boids_bench [--count N] [--backend update|updateThread|"
+                "updateTree|updateTreeThread] [--threads N] [--ticks N] "
+                "[--warmup N] [--grid] [--static] [--double-buffered] "
+                "[--parallel-build] "
+                "[--verlet SKIN] [--topological K] [--sweep STEPS] "
+                "[--isa scalar|sse|avx2|avx512] [--sort N] [--report-locality] "
+                "[--incremental N] [--approximate] [--theta X] "
+                "[--trace PATH] [--seed N] [--load PATH] [--save PATH] "
+                "[--record PATH]\n" );
+}
+
+bool parseOptions( int Argc, char** Argv, Options& Result ) {
+    for ( int i = 1; i < Argc; ++i ) {
+        const std::string_view Arg = Argv[i];
+
+        if ( Arg == "--grid" ) {
+            Result.Grid = true;
+            continue;
+        }
+        if ( Arg == "--static" ) {
+            Result.Static = true;
+            continue;
+        }
+        if ( Arg == "--double-buffered" ) {
+            Result.DoubleBuffered = true;
+            continue;
+        }
+        if ( Arg == "--parallel-build" ) {
+            Result.ParallelBuild = true;
+            continue;
+        }
+        if ( Arg == "--report-locality" ) {
+            Result.ReportLocality = true;
+            continue;
+        }
+        if ( Arg == "--approximate" ) {
+            Result.Approximate = true;
+            continue;
+        }
+
+        if ( i + 1 >= Argc ) return false;
+        const char* Value = Argv[++i];
+
+        if ( Arg == "--count" ) {
+            Result.Count = std::strtoull( Value, nullptr, 10 );
+        } else if ( Arg == "--backend" ) {
+            Result.Backend = Value;
+        } else if ( Arg == "--threads" ) {
+            Result.Threads = std::strtoull( Value, nullptr, 10 );
+        } else if ( Arg == "--ticks" ) {
+            Result.Ticks = std::strtoull( Value, nullptr, 10 );
+        } else if ( Arg == "--warmup" ) {
+            Result.Warmup = std::strtoull( Value, nullptr, 10 );
+        } else if ( Arg == "--verlet" ) {
+            Result.VerletSkin = std::strtof( Value, nullptr );
+        } else if ( Arg == "--topological" ) {
+            Result.Topological = std::strtoull( Value, nullptr, 10 );
+        } else if ( Arg == "--sweep" ) {
+            Result.SweepSteps = std::strtoull( Value, nullptr, 10 );
+        } else if ( Arg == "--isa" ) {
+            Result.Isa = Value;
+        } else if ( Arg == "--sort" ) {
+            Result.SortInterval = std::strtoull( Value, nullptr, 10 );
+        } else if ( Arg == "--incremental" ) {
+            Result.RebuildInterval = std::strtoull( Value, nullptr, 10 );
+        } else if ( Arg == "--theta" ) {
+            Result.Theta = std::strtof( Value, nullptr );
+        } else if ( Arg == "--trace" ) {
+            Result.TracePath = Value;
+        } else if ( Arg == "--load" ) {
+            Result.LoadPath = Value;
+        } else if ( Arg == "--save" ) {
+            Result.SavePath = Value;
+        } else if ( Arg == "--record" ) {
+            Result.RecordPath = Value;
+        } else if ( Arg == "--seed" ) {
+            Result.Seed =
+                static_cast< unsigned >( std::strtoul( Value, nullptr, 10 ) );
+        } else {
+            return false;
+        }
+    }
+
+    return Result.Ticks > 0;
+}
+
+using UpdateFunction = void ( BoidManager::* )();
+
+UpdateFunction findUpdate( const std::string& Name ) {
+    if ( Name == "update" ) return &BoidManager::update;
+    if ( Name == "updateThread" ) return &BoidManager::updateThread;
+    if ( Name == "updateTree" ) return &BoidManager::updateTree;
+    if ( Name == "updateTreeThread" ) return &BoidManager::updateTreeThread;
+
+    return nullptr;
+}
+
+bool findIsa( const std::string& Name, NeighbourKernel::Isa& Use ) {
+    const std::pair< const char*, NeighbourKernel::Isa > Names[] = {
+        { "scalar", NeighbourKernel::I_Scalar },
+        { "sse", NeighbourKernel::I_Sse },
+        { "avx2", NeighbourKernel::I_Avx2 },
+        { "avx512", NeighbourKernel::I_Avx512 } };
+
+    for ( const auto& [Each, Value] : Names ) {
+        if ( Name != Each ) continue;
+
+        Use = Value;
+        return true;
+    }
+
+    return false;
+}
+
+void configure( BoidManager& Manager, const Options& Opts ) {
+    if ( Opts.Threads > 0 ) Manager.setActiveThreads( Opts.Threads );
+    if ( Opts.Grid ) Manager.setNeighbourBackend( B_CellGrid );
+    if ( Opts.Static ) Manager.setWorkStealing( false );
+    if ( Opts.DoubleBuffered ) Manager.setDoubleBuffered( true );
+    if ( Opts.ParallelBuild ) Manager.setParallelTreeBuild( true );
+    if ( Opts.SortInterval > 0 ) Manager.setSortInterval( Opts.SortInterval );
+    if ( Opts.ReportLocality ) Manager.setReportSortLocality( true );
+    if ( Opts.RebuildInterval > 0 )
+        Manager.setIncrementalTree( true, Opts.RebuildInterval );
+    if ( Opts.Approximate ) Manager.setApproximateTree( true );
+    if ( Opts.Theta > 0.f ) Manager.setTheta( Opts.Theta );
+    if ( Opts.VerletSkin > 0.f ) Manager.setVerletLists( true, Opts.VerletSkin );
+    if ( Opts.Topological > 0 )
+        Manager.setTopological( true, Opts.Topological );
+}
+
+// Doubles the flock in the same bounds every step, so the density doubles
+// too. A metric radius sees twice the neighbours each step, k nearest
+// neighbours stay at k.
+int runSweep( const Options& Opts, const UpdateFunction Update ) {
+    fmt::print( "{}{}, {}\n", Opts.Backend, Opts.Grid ? " (grid)" : "",
+                Opts.Topological > 0
+                    ? fmt::format( "{} nearest neighbours", Opts.Topological )
+                    : std::string( "metric radius" ) );
+    fmt::print( "{:>8} {:>14} {:>12}\n", "boids", "ns/boid/tick",
+                "neighbours" );
+
+    for ( size_t s = 0; s < Opts.SweepSteps; ++s ) {
+        BoidManager Manager( Vector2{ 1280.f, 720.f }, Opts.Count << s,
+                             Opts.Seed );
+        configure( Manager, Opts );
+
+        for ( size_t t = 0; t < Opts.Warmup; ++t ) {
+            ( Manager.*Update )();
+        }
+
+        double Neighbours = 0.0;
+        const auto Start = std::chrono::steady_clock::now();
+
+        for ( size_t t = 0; t < Opts.Ticks; ++t ) {
+            ( Manager.*Update )();
+            Neighbours += Manager.getTickStats().NeighbourMean;
+        }
+
+        const auto End = std::chrono::steady_clock::now();
+
+        const double Total =
+            std::chrono::duration< double, std::nano >( End - Start ).count();
+        const double Ticks = static_cast< double >( Opts.Ticks );
+
+        fmt::print( "{:>8} {:>14.1f} {:>12.1f}\n", Manager.getCount(),
+                    Total / Ticks /
+                        static_cast< double >(
+                            std::max< size_t >( Manager.getCount(), 1 ) ),
+                    Neighbours / Ticks );
+    }
+
+    return 0;
+}
+
+} // namespace
+
+int main( int Argc, char** Argv ) {
+    Options Opts;
+    if ( !parseOptions( Argc, Argv, Opts ) ) {
+        printUsage();
+        return 1;
+    }
+
+    const UpdateFunction Update = findUpdate( Opts.Backend );
+    if ( Update == nullptr ) {
+        printUsage();
+        return 1;
+    }
+
+    // Narrower kernels can be timed on a CPU that supports wider ones
+    if ( !Opts.Isa.empty() ) {
+        NeighbourKernel::Isa Use = NeighbourKernel::I_Scalar;
+        if ( !findIsa( Opts.Isa, Use ) ) {
+            printUsage();
+            return 1;
+        }
+
+        NeighbourKernel::setIsa( Use );
+
+        const NeighbourKernel::Isa Active = NeighbourKernel::getIsa();
+        if ( Active != Use )
+            fmt::print( "{} not supported, using {}\n",
+                        NeighbourKernel::getIsaName( Use ),
+                        NeighbourKernel::getIsaName( Active ) );
+    }
+
+    BOIDS_ZONE_THREAD( "Bench" );
+
+    if ( Opts.SweepSteps > 0 ) return runSweep( Opts, Update );
+
+    BoidManager Manager( Vector2{ 1280.f, 720.f }, Opts.Count, Opts.Seed );
+
+    // The checkpoint brings its own flock and settings, flags below still
+    // override them
+    if ( !Opts.LoadPath.empty() && !Manager.loadCheckpoint( Opts.LoadPath ) )
+        return 1;
+
+    configure( Manager, Opts );
+
+    for ( size_t t = 0; t < Opts.Warmup; ++t ) {
+        ( Manager.*Update )();
+    }
+
+    Manager.resetThreadUtilisation();
+
+    // Timed ticks include handing each one to the recorder
+    TrajectoryRecorder Recorder;
+    if ( !Opts.RecordPath.empty() &&
+         !Recorder.start( Opts.RecordPath, Manager.getBounds() ) )
+        return 1;
+
+    const auto Start = std::chrono::steady_clock::now();
+
+    for ( size_t t = 0; t < Opts.Ticks; ++t ) {
+        ( Manager.*Update )();
+        Recorder.record( Manager.getStore(), Manager.getTickStats().Tick );
+    }
+
+    const auto End = std::chrono::steady_clock::now();
+
+    Recorder.stop();
+
+    if ( !Opts.SavePath.empty() && !Manager.saveCheckpoint( Opts.SavePath ) )
+        return 1;
+
+    if ( !Opts.TracePath.empty() ) {
+#ifdef BOIDS_ENABLE_ZONES
+        ZoneProfiler::exportChromeTrace( Opts.TracePath );
+#else
+        fmt::print( "built without BOIDS_ENABLE_ZONES, no trace written\n" );
+#endif
+    }
+
+    const double Total =
+        std::chrono::duration< double, std::nano >( End - Start ).count();
+    const double PerTick = Total / static_cast< double >( Opts.Ticks );
+    const double PerBoid =
+        Manager.getCount() > 0
+            ? PerTick / static_cast< double >( Manager.getCount() )
+            : 0.0;
+
+    fmt::print( "{} boids, {}{}{}{}{}, {} of {} threads, {} kernel\n",
+                Manager.getCount(), Opts.Backend, Opts.Grid ? " (grid)" : "",
+                Opts.DoubleBuffered ? " (double-buffered)" : "",
+                Opts.ParallelBuild ? " (parallel build)" : "",
+                Opts.RebuildInterval > 0 ? " (incremental tree)" : "",
+                Manager.getActiveThreads(), Manager.getThreadCount(),
+                NeighbourKernel::getIsaName( NeighbourKernel::getIsa() ) );
+    fmt::print( "{} ticks in {:.2f} ms, {:.3f} ms/tick, {:.1f} ns/boid/tick\n",
+                Opts.Ticks, Total * 1e-6, PerTick * 1e-6, PerBoid );
+    fmt::print( "{:.1f} neighbours per boid{}\n",
+                Manager.getTickStats().NeighbourMean,
+                Manager.getTopological()
+                    ? fmt::format( ", {} nearest",
+                                   Manager.getTopologicalCount() )
+                    : std::string() );
+
+    if ( Opts.Approximate ) {
+        fmt::print( "Barnes-Hut theta {:.2f}, mean velocity error {:.4f} of "
+                    "the speed limit\n",
+                    Manager.getTheta(), Manager.measureApproximationError() );
+    }
+
+    if ( !Opts.RecordPath.empty() ) {
+        const uint64_t Frames = Recorder.getFrameCount();
+        fmt::print( "{} ticks recorded, {} dropped, {:.1f} MB, "
+                    "{:.2f} bytes/boid/tick\n",
+                    Frames, Recorder.getDroppedCount(),
+                    static_cast< double >( Recorder.getBytesWritten() ) / 1e6,
+                    Frames > 0 && Manager.getCount() > 0
+                        ? static_cast< double >( Recorder.getBytesWritten() ) /
+                              static_cast< double >( Frames *
+                                                     Manager.getCount() )
+                        : 0.0 );
+    }
+
+    const auto Bank = Manager.getQuadtree()->getNodeStats();
+    if ( Bank.HighWater > 0 ) {
+        fmt::print( "Node bank: peak {} nodes, {:.2f} per boid, {} blocks "
+                    "reused\n",
+                    Bank.HighWater,
+                    Manager.getCount() > 0
+                        ? static_cast< double >( Bank.HighWater ) /
+                              static_cast< double >( Manager.getCount() )
+                        : 0.0,
+                    Bank.Reused );
+    }
+
+    if ( Opts.VerletSkin > 0.f ) {
+        fmt::print( "{} Verlet list builds, skin {:.1f}\n",
+                    Manager.getVerletBuildCount(), Opts.VerletSkin );
+    }
+
+    // Only the threaded backends run phases on the pool
+    const std::vector< float > Busy = Manager.getThreadUtilisation();
+    if ( Busy.empty() || Busy.front() <= 0.f ) return 0;
+
+    const auto [Min, Max] = std::minmax_element( Busy.begin(), Busy.end() );
+    const float Mean =
+        std::accumulate( Busy.begin(), Busy.end(), 0.f ) / Busy.size();
+
+    fmt::print( "{} scheduling, busy mean {:.1f}%, min {:.1f}%, max {:.1f}%, "
+                "{} steals\n",
+                Manager.getWorkStealing() ? "work stealing" : "static",
+                Mean * 100.f, *Min * 100.f, *Max * 100.f,
+                Manager.getStealCount() );
+
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef ALLOCATION_COUNTER_HPP
+#define ALLOCATION_COUNTER_HPP
+#pragma once
+
+#include <cstdint>
+
+// Counts every global operator new and delete in the process. Only built with
+// BOIDS_COUNT_ALLOCATIONS, which replaces the global operators with counting
+// ones. Without it nothing is replaced and the counts stay zero.
+namespace AllocationCounter {
+
+bool isEnabled();
+
+uint64_t getAllocations();
+uint64_t getDeallocations();
+
+} // namespace AllocationCounter
+
+#endif
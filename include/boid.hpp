@@ -1,4 +1,3 @@
-
 #ifndef BOID_HPP
 #define BOID_HPP
 #pragma once
@@ -7,50 +6,57 @@
 #include <memory>
 
 #include "raylib.h"
+#include "raymath.h"
 
 struct BoidsUpdateValues {
     BoidsUpdateValues()
         : AvgVelocity( 0.f ), AvgPosition( 0.f ), AvgAvoid( 0.f ), Count( 0 ) {}
 
+    // Adds a neighbour that already passed the LocalSize test
+    void add( const Vector2& Position, const Vector2& OtherPosition,
+              const Vector2& OtherVelocity, const float Distance,
+              const float AvoidDistance ) {
+        Count += 1;
+        // Alignment
+        AvgVelocity = Vector2Add( AvgVelocity, OtherVelocity );
+        // Cohesion
+        AvgPosition = Vector2Add( AvgPosition, OtherPosition );
+        // Separation
+        if ( Distance >= AvoidDistance ) return;
+        AvgAvoid = Vector2Subtract(
+            AvgAvoid,
+            Vector2Scale( Vector2Normalize(
+                              Vector2Subtract( OtherPosition, Position ) ),
+                          10.f / Clamp( Distance, 0.001f, 100.f ) ) );
+    }
+
     Vector2 AvgVelocity;
     Vector2 AvgPosition;
     Vector2 AvgAvoid;
     size_t Count;
 };
 
+// Shared shape and steering parameters of the flock. Per boid state lives in
+// BoidStore.
 class Boid {
 public:
-    Boid( const Vector2& Position_, const float Scale_ );
-    Boid( const Vector2& Position_, const Vector2& Velocity_,
-          const float Scale_, const float SimScale_, const size_t Id_ );
-
-    void update();
-    void draw() const;
-
-    const Vector2 boundPosition( const Vector2& Bounds ) const;
+    Boid( const float Scale_, const float SimScale_ );
 
-    void setVelocity( const Vector2& Velocity_ );
-    void setPosition( const Vector2& Velocity_ );
+    void draw( const Vector2& Position, const Vector2& Velocity ) const;
 
-    const Vector2& getPosition() const;
-    const Vector2& getVelocity() const;
+    const Vector2 boundPosition( const Vector2& Position,
+                                 const Vector2& Bounds ) const;
 
-    const size_t getId() const;
+    float getScale() const { return Scale; }
+    float getSimScale() const { return SimScale; }
 
 private:
-    Vector2 Position = { 0.f };
-    Vector2 Velocity = { 0.f };
-
     float Scale = 7.5f;
     float SimScale = 1.f;
 
     float BoundCorrection = 1.f;
 
     const Vector2 Fwd = { 1.f, 0.f };
-
-    size_t Id = std::numeric_limits< int >::max();
 };
 
-using BoidPtr = std::unique_ptr< Boid >;
-
 #endif
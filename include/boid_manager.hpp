@@ -1,53 +1,361 @@
-
 #ifndef BOID_MANAGER_HPP
 #define BOID_MANAGER_HPP
 #pragma once
 
 #include <array>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
 
 #include "boid.hpp"
+#include "boid_store.hpp"
+#include "bump_arena.hpp"
 
+#include "cell_grid.hpp"
 #include "static_thread_pool.hpp"
 #include "quadtree.hpp"
+#include "work_stealing_scheduler.hpp"
 
 struct Vector2;
 
-enum UpdateStatus { S_Velocity, S_Position };
+enum UpdateStatus {
+    S_Velocity,
+    S_TreeVelocity,
+    S_Position,
+    S_Fused,
+    S_TreeFused,
+    S_BuildVerlet,
+    S_BuildTree,
+    S_StitchTree
+};
+
+// Spatial index used by updateTree and updateTreeThread
+enum NeighbourBackend { B_Quadtree, B_CellGrid };
+
+// What the last tick cost, filled in by every update backend
+struct TickStats {
+    uint64_t Tick = 0;
+    size_t Count = 0;
+
+    // Milliseconds, Velocity includes the fused double-buffered pass
+    float TotalMs = 0.f;
+    float IndexMs = 0.f;
+    float VelocityMs = 0.f;
+    float PositionMs = 0.f;
+
+    // Zero on the grid backend
+    size_t NodeCount = 0;
+    unsigned TreeDepth = 0;
+    // Most nodes the tree has held, what to reserve for this flock
+    size_t NodeHighWater = 0;
+
+    // Boids per bucket of BucketWidth neighbours, the last bucket also
+    // counts everything above it
+    std::array< unsigned, 16 > NeighbourHistogram{};
+    unsigned BucketWidth = 1;
+    float NeighbourMean = 0.f;
+
+    // Busy share of each active worker during the threaded phases
+    std::vector< float > Utilisation;
+
+    // Process wide, so allocations on other threads show up as well. Empty
+    // unless built with BOIDS_COUNT_ALLOCATIONS.
+    std::optional< uint64_t > Allocations;
+};
 
 class BoidManager {
 public:
-    BoidManager( const Vector2 Bounds_ );
+    // A nonzero Seed_ seeds raylib's generator before spawning, so the same
+    // seed always gives the same flock
+    BoidManager( const Vector2 Bounds_, const size_t Count = 5000,
+                 const unsigned Seed_ = 0 );
     void updateTreeThread();
     void updateTree();
     void updateThread();
     void update();
     void draw() const;
+    // Draws a snapshot of the store, Interpolation 0 puts every boid one
+    // tick back along its velocity and 1 at its stored position
+    static void draw( const Boid& Prototype, const BoidStore& Snapshot,
+                      const float Interpolation );
+
+    size_t spawn( const Vector2& Position, const Vector2& Velocity );
+    bool despawn( const size_t Id );
+    // Store slot of a live boid, empty once Id is despawned
+    std::optional< size_t > findSlot( const size_t Id ) const {
+        if ( Id >= Slots.size() || Slots[Id] == InvalidSlot )
+            return std::nullopt;
+
+        return Slots[Id];
+    }
+
+    size_t getCount() const { return Store.size(); }
+    unsigned getSeed() const { return Seed; }
+    Vector2 getBounds() const { return Bounds; }
+
+    // Writes every boid, the parameters and the seed to Path, see
+    // checkpoint.hpp. Also drops the index caches, so this run carries on
+    // exactly like any run restored from the file.
+    bool saveCheckpoint( const std::string& Path );
+    // Replaces the flock and its parameters with the ones in Path. On
+    // failure the flock is left as it was.
+    bool loadCheckpoint( const std::string& Path );
+
+    // Reorders the store along a Z-curve every Ticks ticks, 0 disables it
+    void setSortInterval( const size_t Ticks ) { SortInterval = Ticks; }
+    void sortBoids();
+    // Times every sort and logs the cache lines per neighbourhood before and
+    // after it. Measuring builds its own index, so it allocates.
+    void setReportSortLocality( const bool Report ) {
+        ReportSortLocality = Report;
+    }
+
+    // Splits the quadtree build across the thread pool
+    void setParallelTreeBuild( const bool Parallel ) {
+        ParallelTreeBuild = Parallel;
+    }
+
+    // Keep the quadtree between ticks, reinserting only boids that changed
+    // leaf, with a full rebuild every RebuildInterval ticks
+    void setIncrementalTree( const bool Incremental,
+                             const size_t RebuildInterval = 30 );
+
+    // Flock on Barnes-Hut aggregates instead of exact quadtree neighbours
+    void setApproximateTree( const bool Approximate ) {
+        ApproximateTree = Approximate;
+    }
+    void setTheta( const float Theta ) { QInstance->setTheta( Theta ); }
+    float getTheta() const { return QInstance->getTheta(); }
+
+    // Flocking radius in simulation units
+    void setLocalSize( const float LocalSize_ );
+    float getLocalSize() const { return LocalSize; }
+    bool getApproximateTree() const { return ApproximateTree; }
+
+    // Flock on the Neighbours nearest boids whatever their distance, the
+    // topological rule of starling models. Quadtree backend only, keeps the
+    // work per boid flat however dense the flock gets.
+    void setTopological( const bool Enabled, const size_t Neighbours = 7 );
+    bool getTopological() const { return Topological; }
+    size_t getTopologicalCount() const { return TopologicalCount; }
+
+    // Mean velocity error of the approximation over a sample of boids,
+    // relative to SpeedLimit. Measured on a tree of its own, the simulation
+    // is not advanced or rebuilt.
+    float measureApproximationError();
+
+    // Largest velocity error of the vectorised neighbour kernel against
+    // BoidsUpdateValues::add over a sample of boids, relative to SpeedLimit
+    float measureKernelError() const;
+
+    // Read the tick's state from Store and write the new velocity and
+    // position to a second buffer in one pass, then swap the two. Saves the
+    // position phase and its barrier, and every boid only sees last tick's
+    // neighbours so the threaded results match the sequential ones.
+    void setDoubleBuffered( const bool Enabled ) { DoubleBuffered = Enabled; }
+    bool getDoubleBuffered() const { return DoubleBuffered; }
+
+    // Tree backends keep a list of everything within LocalSize + Skin of
+    // each boid and only search the index again once some boid has moved
+    // more than Skin / 2 since. Ignored while flocking on Barnes-Hut
+    // aggregates.
+    void setVerletLists( const bool Enabled, const float Skin = 10.f );
+    bool getVerletLists() const { return VerletLists; }
+    size_t getVerletBuildCount() const { return VerletBuilds; }
+
+    void setNeighbourBackend( const NeighbourBackend Backend_ );
+    NeighbourBackend getNeighbourBackend() const { return Backend; }
+
+    // Limits the threaded updates to the first Threads pool workers
+    void setActiveThreads( const size_t Threads );
+    size_t getActiveThreads() const { return ActiveThreads; }
+    size_t getThreadCount() const { return ThreadCount; }
+
+    // Deal the velocity phases out in stealable chunks instead of one equal
+    // stride per thread. Tree phases cut chunks by last tick's neighbour
+    // counts.
+    void setWorkStealing( const bool Enabled ) { WorkStealing = Enabled; }
+    bool getWorkStealing() const { return WorkStealing; }
+
+    // Share of the threaded phases' wall time each active worker spent
+    // working since the last reset
+    std::vector< float > getThreadUtilisation() const;
+    // Logs the utilisation and resets it
+    void reportThreadUtilisation();
+    void resetThreadUtilisation();
+    size_t getStealCount() const { return Steals; }
+
+    const TickStats& getTickStats() const { return Stats; }
 
     const std::unique_ptr< Quadtree >& getQuadtree() const { return QInstance; }
+    const BoidStore& getStore() const { return Store; }
+    const Boid& getPrototype() const { return *Prototype; }
+    // The prototype every manager starts with, for drawing a flock without
+    // simulating one
+    static Boid makePrototype();
 
 private:
     void buildTree();
+    void buildSpatialIndex();
+
+    // Builds the index or the Verlet lists as far as this tick needs them
+    void prepareNeighbours( const bool Threaded );
+    bool useVerletLists() const;
+    bool verletListsValid() const;
+    void buildVerletRange( const size_t Chunk, const size_t Begin,
+                           const size_t End );
+    void finishVerletLists( const size_t Chunks );
+
+    void beginTick();
+    void endTick();
+    // Forgets everything derived from the store between ticks
+    void dropCaches();
+    void integrate();
+
+    // Adds the milliseconds Callback took to Into
+    template < typename TCallback >
+    void measure( float& Into, TCallback&& Callback ) {
+        const auto Start = std::chrono::steady_clock::now();
+        Callback();
+        const auto End = std::chrono::steady_clock::now();
 
-    void updateTreeThreadWorker( const size_t ThreadId );
+        Into += static_cast< float >(
+            std::chrono::duration< double, std::milli >( End - Start )
+                .count() );
+    }
+    float measureLocality() const;
+
+    void runPhase( const UpdateStatus Phase );
     void updateThreadWorker( const size_t ThreadId );
 
+    template < typename TCallback >
+    void forEachRange( const size_t ThreadId, TCallback&& Callback ) {
+        if ( WorkStealing ) {
+            Scheduler.run( ThreadId, Callback );
+            return;
+        }
+
+        const size_t Count = Store.size();
+        const size_t Stride = Count / ActiveThreads;
+
+        size_t End = ( ThreadId + 1 ) * Stride;
+        if ( ThreadId == ActiveThreads - 1 ) End = Count;
+
+        Callback( ThreadId * Stride, End );
+    }
+
+    BoidsUpdateValues gatherNeighbours( const size_t Index ) const;
+    // Query results go to Arena, the calling thread's
+    BoidsUpdateValues gatherTreeNeighbours( const size_t Index,
+                                            BumpArena& Arena ) const;
+    BoidsUpdateValues queryNeighbours( const size_t Index,
+                                       BumpArena& Arena ) const;
+    BoidsUpdateValues nearestNeighbours( const size_t Index,
+                                         BumpArena& Arena ) const;
+    BoidsUpdateValues listNeighbours( const size_t Index ) const;
+    Vector2 steeredVelocity( const size_t Index,
+                             BoidsUpdateValues Values ) const;
+    void steer( const size_t Index, BoidsUpdateValues& Values );
+    // Writes the steered velocity and the moved position into Next
+    void advance( const size_t Index, const BoidsUpdateValues& Values );
+
     Vector2 accumulatePosition() const;
     Vector2 accumulateVelocity() const;
 
     Vector2 Bounds;
+    unsigned Seed = 0;
+
+    static constexpr float DefaultLocalSize = 100.f;
+    static constexpr float DefaultSimScale = 0.25f;
 
-    float LocalSize = 100.f;
+    float LocalSize = DefaultLocalSize;
     float SpeedLimit = 7.f;
 
-    float SimScale = 0.25f;
+    float SimScale = DefaultSimScale;
+
+    BoidStore Store;
+    // Write side of the double-buffered updates, only its state is used
+    BoidStore Next;
+    bool DoubleBuffered = false;
+
+    // Store slot of each boid id, InvalidSlot once despawned
+    std::vector< size_t > Slots;
+    std::vector< size_t > FreeIds;
+
+    static constexpr size_t InvalidSlot = std::numeric_limits< size_t >::max();
 
-    static const size_t MAX = 5000;
-    std::array< BoidPtr, MAX > BoidList;
+    size_t SortInterval = 0;
+    size_t TicksSinceSort = 0;
+    bool ReportSortLocality = false;
+
+    std::vector< uint32_t > SortKeys;
+    std::vector< uint32_t > SortKeyScratch;
+    std::vector< unsigned > SortOrder;
+    std::vector< unsigned > SortOrderScratch;
+    BoidStore SortScratch;
+
+    std::unique_ptr< Boid > Prototype;
 
     std::unique_ptr< StaticThreadPool > Stp;
     std::unique_ptr< Quadtree > QInstance;
+    std::unique_ptr< CellGrid > Grid;
+
+    NeighbourBackend Backend = B_Quadtree;
+    bool ParallelTreeBuild = false;
+    bool ApproximateTree = false;
+
+    bool Topological = false;
+    size_t TopologicalCount = 7;
+
+    bool IncrementalTree = false;
+    size_t TreeRebuildInterval = 30;
+    size_t TicksSinceRebuild = 0;
+
+    bool VerletLists = false;
+    bool VerletValid = false;
+    float VerletSkin = 10.f;
+    size_t VerletBuilds = 0;
+
+    // CSR lists, boid i's candidates are
+    // VerletNeighbours[VerletOffsets[i], VerletOffsets[i + 1])
+    std::vector< size_t > VerletOffsets;
+    std::vector< size_t > VerletNeighbours;
+    // One list per worker while building, joined afterwards
+    std::vector< std::vector< size_t > > VerletChunks;
+
+    // Neighbour query results, one arena per worker reset every tick. The
+    // serial paths use the first.
+    std::vector< BumpArena > Arenas;
+    // Positions the lists were built from
+    AlignedVector< float > VerletAnchorX;
+    AlignedVector< float > VerletAnchorY;
 
     size_t ThreadCount;
+    size_t ActiveThreads;
+
+    WorkStealingScheduler Scheduler;
+    bool WorkStealing = true;
+
+    // Neighbours each boid saw last tick plus one, the scheduler's cost
+    std::vector< unsigned > NeighbourCosts;
+
+    struct alignas( 64 ) ThreadLoad {
+        double Busy = 0.0;
+    };
+
+    std::vector< ThreadLoad > ThreadLoads;
+    double PhaseSeconds = 0.0;
+    size_t Steals = 0;
+
+    TickStats Stats;
+    std::chrono::steady_clock::time_point TickStart;
+    uint64_t TickAllocations = 0;
+    double TickPhaseSeconds = 0.0;
+    // Each worker's Busy when the tick started
+    std::vector< double > TickBusy;
 
     UpdateStatus UStatus = S_Velocity;
 };
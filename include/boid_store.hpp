@@ -0,0 +1,87 @@
+#ifndef BOID_STORE_HPP
+#define BOID_STORE_HPP
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "raylib.h"
+
+template < typename T, std::size_t ALIGNMENT = 64 >
+struct AlignedAllocator {
+    using value_type = T;
+
+    template < typename U >
+    struct rebind {
+        using other = AlignedAllocator< U, ALIGNMENT >;
+    };
+
+    AlignedAllocator() noexcept {}
+
+    template < typename U >
+    AlignedAllocator( const AlignedAllocator< U, ALIGNMENT >& ) noexcept {}
+
+    T* allocate( const std::size_t Count ) {
+        return static_cast< T* >( ::operator new(
+            Count * sizeof( T ), std::align_val_t( ALIGNMENT ) ) );
+    }
+
+    void deallocate( T* Ptr, const std::size_t ) noexcept {
+        ::operator delete( Ptr, std::align_val_t( ALIGNMENT ) );
+    }
+
+    template < typename U >
+    bool operator==( const AlignedAllocator< U, ALIGNMENT >& ) const noexcept {
+        return true;
+    }
+};
+
+template < typename T >
+using AlignedVector = std::vector< T, AlignedAllocator< T > >;
+
+// Structure-of-arrays storage for the flock. Each array is cache line aligned
+// so the neighbour loops stream through memory instead of chasing pointers.
+struct BoidStore {
+    void resize( const size_t Count );
+    void reserve( const size_t Count );
+
+    void push( const Vector2& Position, const Vector2& Velocity,
+               const size_t Id );
+    // Moves the last boid into Index so the arrays stay dense
+    void swapRemove( const size_t Index );
+    // Slot i receives the boid currently in slot Order[i]. Gathers into
+    // Scratch and swaps, so reusing Scratch stops it allocating.
+    void reorder( const std::vector< unsigned >& Order, BoidStore& Scratch );
+    // Trades positions and velocities with an equally sized Other, Ids stay
+    void swapState( BoidStore& Other );
+
+    size_t size() const { return Ids.size(); }
+
+    Vector2 getPosition( const size_t Index ) const {
+        return Vector2{ PositionX[Index], PositionY[Index] };
+    }
+
+    Vector2 getVelocity( const size_t Index ) const {
+        return Vector2{ VelocityX[Index], VelocityY[Index] };
+    }
+
+    void setPosition( const size_t Index, const Vector2& Position ) {
+        PositionX[Index] = Position.x;
+        PositionY[Index] = Position.y;
+    }
+
+    void setVelocity( const size_t Index, const Vector2& Velocity ) {
+        VelocityX[Index] = Velocity.x;
+        VelocityY[Index] = Velocity.y;
+    }
+
+    AlignedVector< float > PositionX;
+    AlignedVector< float > PositionY;
+    AlignedVector< float > VelocityX;
+    AlignedVector< float > VelocityY;
+
+    AlignedVector< size_t > Ids;
+};
+
+#endif
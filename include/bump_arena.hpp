@@ -0,0 +1,134 @@
+#ifndef BUMP_ARENA_HPP
+#define BUMP_ARENA_HPP
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for data that only lives until the next reset(). Blocks are
+// kept across resets, so once an arena has seen its busiest tick it stops
+// touching the heap. Not thread safe, each thread owns its own arena.
+class BumpArena {
+public:
+    explicit BumpArena( const size_t BlockSize_ = 64 * 1024 );
+
+    BumpArena( BumpArena&& ) = default;
+    BumpArena& operator=( BumpArena&& ) = default;
+
+    void* allocate( const size_t Bytes, const size_t Alignment );
+
+    template < typename T >
+    T* allocate( const size_t Count ) {
+        static_assert( std::is_trivially_destructible_v< T >,
+                       "Arena memory is dropped without destructors" );
+        return static_cast< T* >(
+            allocate( Count * sizeof( T ), alignof( T ) ) );
+    }
+
+    // Resizes Last, which has to be the latest allocation. Stays in place
+    // when the block has room, otherwise the first Used bytes move.
+    void* grow( void* Last, const size_t Used, const size_t Bytes,
+                const size_t Alignment );
+
+    struct Marker {
+        size_t Block = 0;
+        size_t Top = 0;
+        size_t Passed = 0;
+    };
+
+    // Everything allocated after getMarker() is dropped by rewind()
+    Marker getMarker() const { return Marker{ Current, Top, Passed }; }
+    void rewind( const Marker& Mark );
+
+    // Rewinds while in scope, for results consumed straight away
+    class Scope {
+    public:
+        explicit Scope( BumpArena& Arena_ )
+            : Arena( Arena_ ), Mark( Arena_.getMarker() ) {}
+        ~Scope() { Arena.rewind( Mark ); }
+
+        Scope( const Scope& ) = delete;
+        Scope& operator=( const Scope& ) = delete;
+
+    private:
+        BumpArena& Arena;
+        Marker Mark;
+    };
+
+    // Drops everything. An arena that spilled into several blocks is merged
+    // into one large enough for all of them.
+    void reset();
+
+    size_t getUsed() const { return Passed + Top; }
+    size_t getHighWater() const { return HighWater; }
+    size_t getCapacity() const;
+
+private:
+    struct Block {
+        std::unique_ptr< std::byte[] > Data;
+        size_t Size = 0;
+    };
+
+    // Moves to a block that fits Bytes, reusing ones kept from earlier ticks
+    void nextBlock( const size_t Bytes );
+
+    std::vector< Block > Blocks;
+    size_t BlockSize;
+
+    size_t Current = 0;
+    size_t Top = 0;
+    // Bytes in the blocks before Current
+    size_t Passed = 0;
+    // Where the latest allocation starts, grow() extends it in place
+    size_t LastStart = 0;
+
+    size_t HighWater = 0;
+};
+
+// Array growing at the top of an arena, for results of unknown length. Only
+// valid as long as nothing else is allocated from the arena meanwhile.
+template < typename T >
+class ArenaBuffer {
+public:
+    explicit ArenaBuffer( BumpArena& Arena_, const size_t Capacity_ = 32 )
+        : Arena( Arena_ ),
+          Data( Arena_.allocate< T >( Capacity_ ) ),
+          Capacity( Capacity_ ) {}
+
+    void push_back( const T& Value ) {
+        if ( Count == Capacity ) grow();
+        Data[Count++] = Value;
+    }
+
+    void pop_back() { Count -= 1; }
+
+    T& operator[]( const size_t Index ) { return Data[Index]; }
+    T& back() { return Data[Count - 1]; }
+
+    // Pointers, so std heap and sort functions can work on the buffer
+    T* begin() { return Data; }
+    T* end() { return Data + Count; }
+
+    size_t size() const { return Count; }
+    bool empty() const { return Count == 0; }
+    std::span< T > span() const { return std::span< T >( Data, Count ); }
+
+private:
+    void grow() {
+        const size_t NewCapacity = Capacity * 2 + 1;
+        Data = static_cast< T* >(
+            Arena.grow( Data, Count * sizeof( T ), NewCapacity * sizeof( T ),
+                        alignof( T ) ) );
+        Capacity = NewCapacity;
+    }
+
+    BumpArena& Arena;
+    T* Data;
+    size_t Capacity;
+    size_t Count = 0;
+};
+
+#endif
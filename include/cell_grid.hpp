@@ -0,0 +1,88 @@
+#ifndef CELL_GRID_HPP
+#define CELL_GRID_HPP
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "raylib.h"
+
+#include "boid_store.hpp"
+#include "bump_arena.hpp"
+
+// Uniform grid with cells the size of the interaction radius. Built every
+// tick with a counting sort so each cell's boids are contiguous in Indices.
+class CellGrid {
+public:
+    void build( const BoidStore& Store, const float CellSize_ );
+
+    // Boids within Radius of Pos, kept in Arena until it is rewound or reset
+    std::span< size_t > query( const Vector2& Pos, const float Radius,
+                               BumpArena& Arena ) const;
+
+    // Calls Visit with each of those boids instead
+    template < typename Visitor >
+    void forEachInRadius( const Vector2& Pos, const float Radius,
+                          Visitor&& Visit ) const;
+
+    void clear();
+
+    size_t getCellCount() const {
+        return CellStart.empty() ? 0 : CellStart.size() - 1;
+    }
+    float getCellSize() const { return CellSize; }
+
+private:
+    int cellX( const float X ) const;
+    int cellY( const float Y ) const;
+
+    // Upper bound on cells along one axis if a boid strays far away
+    static const int MaxCellsPerAxis = 4096;
+
+    std::vector< unsigned > CellStart;
+    std::vector< unsigned > CellOf;
+    std::vector< unsigned > Indices;
+    // Scratch for the sort, kept so rebuilds don't allocate
+    std::vector< unsigned > Cursor;
+
+    const BoidStore* Source = nullptr;
+
+    Vector2 Origin = { 0.f };
+
+    float CellSize = 1.f;
+    float InvCellSize = 1.f;
+
+    int Columns = 0;
+    int Rows = 0;
+};
+
+template < typename Visitor >
+void CellGrid::forEachInRadius( const Vector2& Pos, const float Radius,
+                                Visitor&& Visit ) const {
+    if ( Source == nullptr || Indices.empty() ) return;
+
+    const int MinX = cellX( Pos.x - Radius );
+    const int MaxX = cellX( Pos.x + Radius );
+    const int MinY = cellY( Pos.y - Radius );
+    const int MaxY = cellY( Pos.y + Radius );
+
+    const float RadiusSqr = Radius * Radius;
+
+    for ( int y = MinY; y <= MaxY; ++y ) {
+        for ( int x = MinX; x <= MaxX; ++x ) {
+            const size_t Cell = static_cast< size_t >( y * Columns + x );
+
+            for ( unsigned i = CellStart[Cell]; i < CellStart[Cell + 1];
+                  ++i ) {
+                const unsigned Other = Indices[i];
+
+                const float Dx = Source->PositionX[Other] - Pos.x;
+                const float Dy = Source->PositionY[Other] - Pos.y;
+
+                if ( Dx * Dx + Dy * Dy < RadiusSqr ) Visit( size_t{ Other } );
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+// On-disk layout written by BoidManager::saveCheckpoint. Little endian, the
+// header is followed by the store arrays, each starting on an Alignment
+// boundary so a mapped file can be read in place. Bump Version whenever the
+// layout changes.
+namespace Checkpoint {
+
+constexpr std::array< char, 8 > Magic = { 'B', 'O', 'I', 'D', 'S',
+                                          'C', 'K', '\0' };
+constexpr uint32_t Version = 1;
+constexpr uint64_t Alignment = 64;
+
+// Bits of Header::Flags
+constexpr uint32_t F_ApproximateTree = 1 << 0;
+constexpr uint32_t F_IncrementalTree = 1 << 1;
+constexpr uint32_t F_ParallelTreeBuild = 1 << 2;
+constexpr uint32_t F_DoubleBuffered = 1 << 3;
+constexpr uint32_t F_VerletLists = 1 << 4;
+constexpr uint32_t F_WorkStealing = 1 << 5;
+constexpr uint32_t F_Topological = 1 << 6;
+
+struct Header {
+    std::array< char, 8 > Magic;
+    uint32_t Version;
+    uint32_t HeaderSize;
+
+    uint64_t Count;
+    // Ids handed out so far, live boids plus FreeIdCount
+    uint64_t SlotCount;
+    uint64_t FreeIdCount;
+    uint64_t Tick;
+
+    uint32_t Seed;
+    uint32_t Backend;
+    uint32_t Flags;
+    uint32_t SortInterval;
+    uint32_t TicksSinceSort;
+    uint32_t TreeRebuildInterval;
+
+    float BoundsX;
+    float BoundsY;
+    float LocalSize;
+    float SpeedLimit;
+    float SimScale;
+    float Theta;
+    float VerletSkin;
+    uint32_t TopologicalCount;
+
+    // Byte offsets from the start of the file
+    uint64_t PositionX;
+    uint64_t PositionY;
+    uint64_t VelocityX;
+    uint64_t VelocityY;
+    uint64_t Ids;
+    uint64_t FreeIds;
+};
+
+static_assert( std::is_trivially_copyable_v< Header > );
+static_assert( sizeof( Header ) % 8 == 0,
+               "Header should have no tail padding" );
+
+} // namespace Checkpoint
+
+#endif
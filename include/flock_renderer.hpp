@@ -0,0 +1,79 @@
+#ifndef FLOCK_RENDERER_HPP
+#define FLOCK_RENDERER_HPP
+#pragma once
+
+#include <array>
+#include <chrono>
+
+#include "boid.hpp"
+#include "boid_store.hpp"
+
+// Draws the whole flock with one instanced call. The store's SoA arrays are
+// uploaded as four per-instance attributes and the vertex shader orients the
+// shared boid mesh along each velocity. Needs an open window.
+class FlockRenderer {
+public:
+    FlockRenderer( const Boid& Prototype );
+    ~FlockRenderer();
+
+    FlockRenderer( const FlockRenderer& ) = delete;
+    FlockRenderer& operator=( const FlockRenderer& ) = delete;
+
+    // Interpolation below 1 draws boids back along their velocity, see
+    // FlockSnapshot
+    void draw( const BoidStore& Store, const float Interpolation = 1.f );
+
+    // False when the GPU lacks shaders or vertex arrays, draw with
+    // BoidManager::draw instead
+    bool isReady() const { return Shader != 0 && Vao != 0; }
+
+private:
+    void reserve( const size_t Count );
+
+    unsigned Shader = 0;
+    unsigned Vao = 0;
+    unsigned MeshVbo = 0;
+
+    // PositionX, PositionY, VelocityX, VelocityY
+    std::array< unsigned, 4 > InstanceVbos{};
+    std::array< int, 4 > InstanceLocations{};
+
+    int MvpLocation = -1;
+    int InterpolationLocation = -1;
+
+    int MeshVertexCount = 0;
+    size_t Capacity = 0;
+};
+
+// Alternates between the legacy and instanced draw paths and logs the mean
+// frame and draw times of each
+class RenderComparison {
+public:
+    void start( const size_t FramesPerPath = 300 );
+    bool isRunning() const { return Phase != P_Idle; }
+
+    bool useLegacy() const { return Phase == P_Legacy; }
+
+    void beginDraw();
+    void endDraw();
+
+    void endFrame( const float DeltaTime );
+
+private:
+    enum ComparisonPhase { P_Idle, P_Legacy, P_Instanced };
+
+    void report() const;
+
+    ComparisonPhase Phase = P_Idle;
+
+    size_t FramesPerPath = 0;
+    size_t Frames = 0;
+
+    std::chrono::time_point< std::chrono::steady_clock > DrawStart;
+
+    // Legacy then instanced
+    std::array< double, 2 > FrameTime{};
+    std::array< double, 2 > DrawTime{};
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file mapped into memory. Pages are only read in
+// as they are touched, so opening is cheap regardless of the file size.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator=( const MappedFile& ) = delete;
+
+    MappedFile( MappedFile&& Other ) noexcept;
+    MappedFile& operator=( MappedFile&& Other ) noexcept;
+
+    // Fails on missing or empty files
+    bool open( const std::string& Path );
+    void close();
+
+    bool isOpen() const { return Data != nullptr; }
+
+    const std::byte* data() const { return Data; }
+    size_t size() const { return Size; }
+
+    // Asks the OS to start reading a range in before it is touched
+    void prefetch( const size_t Offset, const size_t Length ) const;
+
+    // Count Ts starting at Offset, nullptr when they run past the end
+    template < typename T >
+    const T* get( const size_t Offset, const size_t Count = 1 ) const {
+        if ( Offset > Size || Count > ( Size - Offset ) / sizeof( T ) )
+            return nullptr;
+
+        return reinterpret_cast< const T* >( Data + Offset );
+    }
+
+private:
+    const std::byte* Data = nullptr;
+    size_t Size = 0;
+
+#ifdef _WIN32
+    void* File = nullptr;
+    void* Mapping = nullptr;
+#endif
+};
+
+#endif
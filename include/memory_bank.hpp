@@ -1,32 +1,82 @@
-
 #ifndef MEMORY_BANK_HPP
 #define MEMORY_BANK_HPP
 #pragma once
 
-#include <deque>
-#include <memory>
-
-struct Quad;
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
 
+// Contiguous node storage handed out in blocks. Blocks of four given back
+// with storeBlock() are reused before the array grows, and reset() drops
+// every node at once while keeping the memory. Not synchronised, parallel
+// builds fill per-worker caches and claim one block per worker afterwards.
+template < typename T >
 class MemoryBank {
+    static_assert( std::is_trivially_destructible_v< T >,
+                   "reset() drops nodes without destroying them" );
+
 public:
-    MemoryBank();
-    ~MemoryBank();
-    MemoryBank( const MemoryBank& );
-    MemoryBank( MemoryBank&& );
+    struct Stats {
+        // Nodes handed out, free blocks included
+        size_t Size = 0;
+        // Most nodes held at once since the bank was created
+        size_t HighWater = 0;
+        size_t Capacity = 0;
+        size_t FreeBlocks = 0;
+        // Blocks of four reused instead of growing, since the last reset
+        size_t Reused = 0;
+    };
 
-    std::unique_ptr< Quad > get();
-    void store( std::unique_ptr< Quad > ToAdd );
+    // First of Count contiguous default constructed nodes
+    unsigned getBlock( const size_t Count ) {
+        if ( Count == 4 && !FreeBlocks.empty() ) {
+            const unsigned First = FreeBlocks.back();
+            FreeBlocks.pop_back();
+            Reused += 1;
+            return First;
+        }
 
-private:
-    void allocate();
+        const size_t First = Nodes.size();
+        Nodes.resize( First + Count );
+        HighWater = std::max( HighWater, Nodes.size() );
+
+        return static_cast< unsigned >( First );
+    }
+
+    // Gives back a block of four, its nodes stay readable until reused
+    void storeBlock( const unsigned First ) { FreeBlocks.push_back( First ); }
+
+    void reset() {
+        Nodes.clear();
+        FreeBlocks.clear();
+        Reused = 0;
+    }
 
-    std::deque< std::unique_ptr< Quad > > Bank;
+    void reserve( const size_t Count ) { Nodes.reserve( Count ); }
 
-    const size_t BlockSize = 512;
+    // Reused blocks break the parent before children order of fresh ones
+    bool hasReusedBlocks() const { return Reused > 0; }
+
+    T& operator[]( const size_t Index ) { return Nodes[Index]; }
+    const T& operator[]( const size_t Index ) const { return Nodes[Index]; }
+
+    size_t size() const { return Nodes.size(); }
+    bool empty() const { return Nodes.empty(); }
+
+    const std::vector< T >& getNodes() const { return Nodes; }
+
+    Stats getStats() const {
+        return Stats{ Nodes.size(), HighWater, Nodes.capacity(),
+                      FreeBlocks.size(), Reused };
+    }
+
+private:
+    std::vector< T > Nodes;
+    std::vector< unsigned > FreeBlocks;
 
-    size_t TotalSize = 0;
-    size_t UsedSize = 0;
+    size_t HighWater = 0;
+    size_t Reused = 0;
 };
 
 #endif
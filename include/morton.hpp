@@ -0,0 +1,33 @@
+#ifndef MORTON_HPP
+#define MORTON_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Morton {
+
+// Spreads the low 16 bits of Value over the even bits of the result
+inline uint32_t part1By1( uint32_t Value ) {
+    Value &= 0x0000ffff;
+    Value = ( Value | ( Value << 8 ) ) & 0x00ff00ff;
+    Value = ( Value | ( Value << 4 ) ) & 0x0f0f0f0f;
+    Value = ( Value | ( Value << 2 ) ) & 0x33333333;
+    Value = ( Value | ( Value << 1 ) ) & 0x55555555;
+    return Value;
+}
+
+inline uint32_t encode( const uint32_t X, const uint32_t Y ) {
+    return part1By1( X ) | ( part1By1( Y ) << 1 );
+}
+
+// LSD radix sort of Keys, carrying Values along. Scratch buffers are resized
+// as needed and can be reused between calls.
+void radixSort( std::vector< uint32_t >& Keys, std::vector< unsigned >& Values,
+                std::vector< uint32_t >& KeyScratch,
+                std::vector< unsigned >& ValueScratch );
+
+} // namespace Morton
+
+#endif
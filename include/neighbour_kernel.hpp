@@ -0,0 +1,43 @@
+#ifndef NEIGHBOUR_KERNEL_HPP
+#define NEIGHBOUR_KERNEL_HPP
+#pragma once
+
+#include <cstddef>
+
+#include "raylib.h"
+
+#include "boid.hpp"
+#include "boid_store.hpp"
+
+// Vectorised version of BoidsUpdateValues::add over SoA candidates. Rejects
+// on squared distance and replaces the sqrt and division of the separation
+// term with a refined rsqrt. The widest instruction set the CPU supports is
+// picked on first use.
+namespace NeighbourKernel {
+
+enum Isa { I_Scalar, I_Sse, I_Avx2, I_Avx512 };
+
+Isa getSupportedIsa();
+
+Isa getIsa();
+// Clamped to what the CPU supports
+void setIsa( const Isa Use );
+
+const char* getIsaName( const Isa Use );
+
+// Accumulates boids Begin to End, including the boid at Position itself
+void accumulate( const BoidStore& Store, const size_t Begin, const size_t End,
+                 const Vector2& Position, const float Radius,
+                 const float AvoidDistance, BoidsUpdateValues& Values,
+                 const Isa Use = getIsa() );
+
+// Accumulates the listed boids, skipping Exclude
+void accumulate( const BoidStore& Store, const size_t* Indices,
+                 const size_t Count, const size_t Exclude,
+                 const Vector2& Position, const float Radius,
+                 const float AvoidDistance, BoidsUpdateValues& Values,
+                 const Isa Use = getIsa() );
+
+} // namespace NeighbourKernel
+
+#endif
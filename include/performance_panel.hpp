@@ -0,0 +1,61 @@
+#ifndef PERFORMANCE_PANEL_HPP
+#define PERFORMANCE_PANEL_HPP
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "boid_manager.hpp"
+#include "simulation_thread.hpp"
+
+// Editor window with rolling graphs of what each tick cost and controls to
+// retune the flock live. Changes go through SimulationThread::post so they
+// land between ticks whether or not the simulation has its own thread.
+class PerformancePanel {
+public:
+    PerformancePanel( const BoidManager& Manager,
+                      SimulationThread& Simulation_ );
+
+    // Call every frame with the newest stats, ticks already seen are skipped
+    void record( const TickStats& Stats );
+
+    // Pass to Editor::addDisplayMenuCallback
+    void display();
+
+private:
+    static constexpr size_t HistoryLength = 240;
+
+    struct History {
+        void push( const float Value );
+        float getLatest() const;
+
+        std::array< float, HistoryLength > Values{};
+        size_t Offset = 0;
+    };
+
+    void plot( const char* Label, const History& Values,
+               const char* Unit ) const;
+    void displayControls();
+
+    SimulationThread& Simulation;
+
+    TickStats Latest;
+    bool HasStats = false;
+
+    History TotalMs;
+    History IndexMs;
+    History VelocityMs;
+    History PositionMs;
+    History Allocations;
+
+    // Mirrors of what was last sent to the manager
+    int UpdateIndex = 0;
+    int BackendIndex = 0;
+    float LocalSize = 0.f;
+    float Theta = 0.f;
+    bool Approximate = false;
+    bool Topological = false;
+    int TopologicalCount = 7;
+};
+
+#endif
@@ -3,14 +3,20 @@
 #define QUADTREE_HPP
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <functional>
+#include <limits>
+#include <span>
 #include <vector>
 
 #include "raylib.h"
 #include "raymath.h"
 
 #include "boid.hpp"
+#include "boid_store.hpp"
+#include "bump_arena.hpp"
 #include "memory_bank.hpp"
 
 #include <fmt/core.h>
@@ -21,37 +27,15 @@ struct Quad {
 
     void init();
 
-    template < std::size_t SIZE >
-    Quad* createRoot( const std::array< BoidPtr, SIZE >& ParticleList ) {
-        Vector2 Min = Vector2{ std::numeric_limits< float >::max(),
-                               std::numeric_limits< float >::max() };
-        Vector2 Max = Vector2{ std::numeric_limits< float >::min(),
-                               std::numeric_limits< float >::min() };
-
-        for ( auto& ThisParticle : ParticleList ) {
-            Min.x = std::min( Min.x, ThisParticle->getPosition().x );
-            Min.y = std::min( Min.y, ThisParticle->getPosition().y );
-            Max.x = std::max( Max.x, ThisParticle->getPosition().x );
-            Max.y = std::max( Max.y, ThisParticle->getPosition().y );
-        }
-
-        Center = Vector2Add( Min, Max );
-        Center = Vector2Scale( Center, 0.5f );
-
-        Size = std::max( Max.x - Min.x, Max.y - Min.y );
-        HalfSize = Size * 0.5f;
-
-        return this;
-    }
+    Quad* createRoot( const BoidStore& Store, const float Padding );
 
     unsigned findQuad( const Vector2& Pos );
 
-    bool intersects( const Vector2& Pos, const float HalfSize_ ) const;
-
+    bool containsPoint( const Vector2& Pos ) const;
     bool hasChildren() const;
     bool isEmpty() const;
 
-    void subdivide( Quad* Parent, unsigned QuadrantId );
+    void subdivide( const Quad* Parent, unsigned QuadrantId );
 
     void printSimple( const unsigned Id ) const;
 
@@ -60,14 +44,20 @@ struct Quad {
 
     Vector2 Center = { 0.f };
 
-    Boid* Body = nullptr;
-
     float Size = 0.f;
-    float HalfSize = 0.f;
 
     int BodyId = -1;
 };
 
+static_assert( sizeof( Quad ) == 24, "Quad should stay compact" );
+
+// Sums of every body below a node, filled by computeAggregates
+struct QuadAggregate {
+    Vector2 SumPosition = { 0.f };
+    Vector2 SumVelocity = { 0.f };
+    unsigned Count = 0;
+};
+
 class Quadtree {
 public:
     Quadtree();
@@ -75,92 +65,203 @@ public:
     Quadtree( const Quadtree& );
     Quadtree( Quadtree&& );
 
-    template < std::size_t SIZE >
-    void initialize( const std::array< BoidPtr, SIZE >& ParticleList ) {
-        Nodes.push_back( std::move( Mb->get() ) );
+    void initialize( const BoidStore& Store );
+
+    // Bulk build of the whole store, equivalent to inserting every boid.
+    // build() runs every phase on the calling thread. A parallel build calls
+    // beginBuild, buildTasks from every worker, allocateTasks, then
+    // stitchTasks from every worker. Both produce the same node array,
+    // byte for byte, whatever the worker count.
+    void build( const BoidStore& Store );
+    void beginBuild( const BoidStore& Store, const size_t WorkerCount );
+    void buildTasks( const size_t Worker, const size_t WorkerCount );
+    void allocateTasks();
+    void stitchTasks( const size_t Worker, const size_t WorkerCount );
+
+    // Reinserts only the boids that left their leaf and folds emptied
+    // subtrees. Returns false when a full rebuild is needed instead. Boids
+    // dropped for sharing a spot are only retried once they leave it.
+    bool update( const BoidStore& Store );
+
+    // Extra room around the root so boids stay inside between rebuilds
+    void setRootPadding( const float Padding ) { RootPadding = Padding; }
+
+    // Boids closer than Radius to Pos, kept in Arena until it is rewound or
+    // reset
+    std::span< size_t > query( const BoidStore& Store, const Vector2& Pos,
+                               const float Radius, BumpArena& Arena ) const;
+
+    // Calls Visit with each of those boids instead. Nodes whose square is
+    // out of reach are skipped whole, leaves are tested by exact distance.
+    template < typename Visitor >
+    void forEachInRadius( const BoidStore& Store, const Vector2& Pos,
+                          const float Radius, Visitor&& Visit ) const;
+
+    // The K boids nearest to Pos, nearest first, leaving out Exclude. Nodes
+    // are expanded closest first from a heap and the K best kept in a bounded
+    // max-heap, so the walk stops once no node can beat the K-th distance.
+    std::span< size_t > findNearest( const BoidStore& Store, const Vector2& Pos,
+                                     const size_t K, const size_t Exclude,
+                                     BumpArena& Arena ) const;
+
+    void insert( const BoidStore& Store, const size_t Index );
+    void remove( const size_t Index );
+    // Relabels the leaf holding From after a swap-remove moved it to To
+    void move( const size_t From, const size_t To );
+
+    bool contains( const Vector2& Pos ) const;
 
-        auto& RootNode = Nodes.front();
-        RootNode->createRoot( ParticleList );
-    }
+    unsigned subdivide( unsigned NodeId );
 
-    std::vector< Boid* > query( const Vector2& Pos, const float HalfSize );
+    void clear();
 
-    void insert( Boid* ThisBody );
+    void computeAggregates( const BoidStore& Store );
 
-    unsigned subdivide( unsigned NodeId );
+    // Barnes-Hut walk, nodes passing the Theta test contribute their
+    // aggregates. Nodes holding Index are always opened, so it never counts
+    // itself. Needs computeAggregates after the last build.
+    BoidsUpdateValues calculateVelocity( const BoidStore& Store,
+                                         const size_t Index,
+                                         const float LocalSize );
 
-    void clear();
+    void setTheta( const float Theta_ );
+    float getTheta() const { return Theta; }
 
-    template < std::size_t SIZE >
-    BoidsUpdateValues
-    calculateVelocity( const std::array< BoidPtr, SIZE >& ParticleList,
-                       const BoidPtr& ThisBody, const float LocalSize ) {
-        BoidsUpdateValues Values;
-
-        size_t NodeId = Root;
-
-        while ( true ) {
-            const auto& Node = Nodes[NodeId];
-
-            const float DistanceSqr =
-                Vector2DistanceSqr( ThisBody->getPosition(), Node->Center );
-
-            if ( !Node->hasChildren() ||
-                 ( Node->Size * Node->Size ) < DistanceSqr * SquareTheta ) {
-                // TODO: Compute velocity
-
-                if ( !Node->isEmpty() ) {
-                    auto& OtherBoid = ParticleList[Node->BodyId];
-
-                    const float Distance = Vector2Distance(
-                        ThisBody->getPosition(), OtherBoid->getPosition() );
-
-                    if ( Distance < LocalSize ) {
-                        Values.Count += 1;
-                        // Alignment
-                        Values.AvgVelocity = Vector2Add(
-                            Values.AvgVelocity, OtherBoid->getVelocity() );
-                        // Cohesion
-                        Values.AvgPosition = Vector2Add(
-                            Values.AvgPosition, OtherBoid->getPosition() );
-                        // Separation
-                        if ( Distance < ( LocalSize * 0.4f ) ) {
-                            Values.AvgAvoid = Vector2Subtract(
-                                Values.AvgAvoid,
-                                Vector2Scale(
-                                    Vector2Normalize( Vector2Subtract(
-                                        OtherBoid->getPosition(),
-                                        ThisBody->getPosition() ) ),
-                                    10.f / Clamp( Distance, 0.001f, 100.f ) ) );
-                        }
-                    }
-                }
-                if ( Node->Next == 0 ) break;
-
-                NodeId = Node->Next;
-            } else {
-                NodeId = Node->Children;
-            }
-        }
+    const std::vector< Quad >& getNodes() const;
 
-        return Values;
-    }
+    // Nodes reachable from the root, skipping free blocks. Depth is set to
+    // the number of levels below the root.
+    size_t countNodes( unsigned& Depth ) const;
 
-    const std::vector< std::unique_ptr< Quad > >& getNodes();
+    // Bumped whenever node geometry changes, lets views cache what they
+    // derive from the tree
+    size_t getRevision() const { return Revision; }
 
-private:
-    void query( std::vector< Boid* >& Targets, const Quad* Node,
-                const Vector2& Pos, const float HalfSize );
+    // The high water mark tells how many nodes a flock needs. reserveNodes
+    // sizes the bank and every worker's build cache for Count nodes, builds
+    // call it themselves once the tree outgrows them.
+    MemoryBank< Quad >::Stats getNodeStats() const {
+        return Nodes.getStats();
+    }
+    void reserveNodes( const size_t Count );
 
-    std::vector< std::unique_ptr< Quad > > Nodes;
+private:
+    size_t countNodes( const unsigned NodeId, const unsigned Level,
+                       unsigned& Depth ) const;
+
+    void setBodyNode( const size_t Index, const unsigned NodeId );
+    void collapse( unsigned NodeId );
+
+    struct BuildTask {
+        unsigned NodeId;
+        unsigned Begin;
+        unsigned End;
+        unsigned Depth;
+        // Where the subtree landed in its worker's cache
+        unsigned NodeBegin;
+        unsigned NodeEnd;
+        // Where it goes in the bank
+        unsigned NodeBase;
+    };
+
+    void splitTop( const unsigned NodeId, const unsigned Depth,
+                   const unsigned KeyBegin, const unsigned KeyEnd );
+    bool sameLocation( const unsigned Begin, const unsigned End ) const;
+    // Drops BuildOrder[Begin + 1, End), all on the spot of BuildOrder[Begin]
+    void dropBodies( const unsigned Begin, const unsigned End );
+    void dropBody( const size_t Index, const unsigned Twin );
+    bool sharesSpot( const BoidStore& Store, const size_t Index ) const;
+    unsigned buildChildren( std::vector< Quad >& Local, const Quad& Parent,
+                            const unsigned ParentNext, const unsigned Begin,
+                            const unsigned End, const unsigned Depth );
+
+    // Nodes by value, each node's children are a contiguous block of four.
+    // Blocks freed by collapse() are reused by subdivide().
+    MemoryBank< Quad > Nodes;
+    std::vector< QuadAggregate > Aggregates;
+    // Parent of each node, NoNode for the root and dead blocks
     std::vector< unsigned > Parents;
-
-    std::unique_ptr< MemoryBank > Mb;
+    bool ParentsValid = true;
+
+    std::vector< unsigned > Moved;
+    std::vector< unsigned > Vacated;
+    std::vector< unsigned > AggregateOrder;
+
+    float RootPadding = 0.f;
+
+    size_t Revision = 0;
+
+    // Leaf holding each store slot, NoNode or Dropped for the ones outside
+    std::vector< unsigned > BodyNodes;
+    // For Dropped slots, the slot in the tree they share a spot with
+    std::vector< unsigned > Twins;
+
+    // Bulk build state. BuildOrder holds store slots grouped by subtree, each
+    // worker builds its tasks' subtrees into its own WorkerNodes cache.
+    // allocateTasks claims one block for all of them, in task order.
+    const BoidStore* BuildStore = nullptr;
+    std::vector< unsigned > BuildOrder;
+    // Kept between builds so they stop allocating
+    std::vector< unsigned > BuildKeys;
+    std::vector< unsigned > BuildCursor;
+    std::vector< unsigned > KeyStart;
+    std::vector< BuildTask > Tasks;
+    std::vector< std::vector< Quad > > WorkerNodes;
+
+    // Levels split on the calling thread before handing out tasks
+    static const unsigned SplitDepth = 3;
+    // Bodies still sharing a leaf this deep are at the same location
+    static const unsigned MaxDepth = 32;
 
     float SquareTheta;
     float Theta;
 
     const unsigned Root = 0;
+
+    static constexpr unsigned NoNode = std::numeric_limits< unsigned >::max();
+    // Body left out for sharing its spot with one already in the tree.
+    // update() leaves it alone for as long as it stays on that spot.
+    static constexpr unsigned Dropped = NoNode - 1;
 };
 
+template < typename Visitor >
+void Quadtree::forEachInRadius( const BoidStore& Store, const Vector2& Pos,
+                                const float Radius, Visitor&& Visit ) const {
+    if ( Nodes.empty() ) return;
+
+    const float RadiusSqr = Radius * Radius;
+
+    // Stackless walk, Children to descend and Next to skip a subtree
+    unsigned NodeId = Root;
+
+    while ( true ) {
+        const Quad& Node = Nodes[NodeId];
+
+        if ( Node.hasChildren() ) {
+            // Distance from Pos to the node's square
+            const float HalfSize = Node.Size * 0.5f;
+            const float Dx =
+                std::max( std::fabs( Pos.x - Node.Center.x ) - HalfSize, 0.f );
+            const float Dy =
+                std::max( std::fabs( Pos.y - Node.Center.y ) - HalfSize, 0.f );
+
+            if ( Dx * Dx + Dy * Dy < RadiusSqr ) {
+                NodeId = Node.Children;
+                continue;
+            }
+        } else if ( !Node.isEmpty() ) {
+            // Only leaves hold bodies, their own distance is the whole test
+            const size_t Body = static_cast< size_t >( Node.BodyId );
+            const float Bx = Store.PositionX[Body] - Pos.x;
+            const float By = Store.PositionY[Body] - Pos.y;
+
+            if ( Bx * Bx + By * By < RadiusSqr ) Visit( Body );
+        }
+
+        if ( Node.Next == 0 ) break;
+
+        NodeId = Node.Next;
+    }
+}
+
 #endif
@@ -0,0 +1,78 @@
+#ifndef QUADTREE_OVERLAY_HPP
+#define QUADTREE_OVERLAY_HPP
+#pragma once
+
+#include <limits>
+#include <vector>
+
+#include "raylib.h"
+
+#include "quadtree.hpp"
+
+// Debug view of the quadtree node bounds. The edges are cached as a line list
+// and uploaded to one vertex buffer, both only rebuilt when the tree revision
+// or the depth filter changes. Needs an open window.
+class QuadtreeOverlay {
+public:
+    QuadtreeOverlay();
+    ~QuadtreeOverlay();
+
+    QuadtreeOverlay( const QuadtreeOverlay& ) = delete;
+    QuadtreeOverlay& operator=( const QuadtreeOverlay& ) = delete;
+
+    void draw( const Quadtree& Tree );
+    // Nodes copied out of a tree, e.g. a FlockSnapshot
+    void draw( const std::vector< Quad >& Nodes, const size_t Revision );
+
+    void setEnabled( const bool Enabled_ ) { Enabled = Enabled_; }
+    bool isEnabled() const { return Enabled; }
+
+    // Nodes deeper than MaxDepth are hidden, the root is depth 0
+    void setMaxDepth( const unsigned MaxDepth_ ) { MaxDepth = MaxDepth_; }
+    unsigned getMaxDepth() const { return MaxDepth; }
+    // Moves the filter by Delta within the depth of the last drawn tree,
+    // stepping past the deepest level shows every level again
+    void stepMaxDepth( const int Delta );
+
+    unsigned getTreeDepth() const { return TreeDepth; }
+
+    bool isReady() const { return Shader != 0 && Vao != 0; }
+
+    static constexpr unsigned AllDepths =
+        std::numeric_limits< unsigned >::max();
+
+private:
+    void rebuild( const std::vector< Quad >& Nodes );
+    void upload();
+
+    void addLine( const Vector2& From, const Vector2& To );
+
+    // Pairs of end points, the edges of every visible node once each
+    std::vector< Vector2 > Lines;
+    // Lines widened into two triangles each, rlgl only draws triangle arrays
+    std::vector< Vector2 > Vertices;
+
+    unsigned Shader = 0;
+    unsigned Vao = 0;
+    unsigned Vbo = 0;
+
+    int MvpLocation = -1;
+    int ColorLocation = -1;
+    int PositionLocation = -1;
+
+    size_t Capacity = 0;
+
+    bool HasCache = false;
+    size_t CachedRevision = 0;
+    unsigned CachedDepth = 0;
+
+    unsigned MaxDepth = AllDepths;
+    unsigned TreeDepth = 0;
+
+    float LineWidth = 1.f;
+    Color LineColor = RED;
+
+    bool Enabled = true;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef REPLAY_PANEL_HPP
+#define REPLAY_PANEL_HPP
+#pragma once
+
+#include "trajectory_replay.hpp"
+
+// Editor window for scrubbing through a recorded trajectory. While playing,
+// every fixed update moves on one recorded tick.
+class ReplayPanel {
+public:
+    explicit ReplayPanel( TrajectoryReplay& Replay_ );
+
+    // Call once per fixed update
+    void update();
+
+    void togglePlaying() { Playing = !Playing; }
+    // Pauses and moves Delta frames, clamped to the recording
+    void step( const int Delta );
+
+    // Pass to Editor::addDisplayMenuCallback
+    void display();
+
+private:
+    void seek( const int Frame_ );
+
+    TrajectoryReplay& Replay;
+
+    int Frame = 0;
+    bool Playing = true;
+    bool Loop = true;
+};
+
+#endif
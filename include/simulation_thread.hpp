@@ -0,0 +1,93 @@
+#ifndef SIMULATION_THREAD_HPP
+#define SIMULATION_THREAD_HPP
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "boid_manager.hpp"
+#include "boid_store.hpp"
+#include "quadtree.hpp"
+#include "trajectory_recorder.hpp"
+#include "triple_buffer.hpp"
+
+// Immutable copy of the flock after one tick. Positions were advanced by
+// exactly Velocity during the tick, so Position - Velocity is where each boid
+// was one tick earlier and the renderer can interpolate from a single
+// snapshot even when boids were spawned, despawned or reordered.
+struct FlockSnapshot {
+    BoidStore Store;
+
+    std::vector< Quad > Nodes;
+    size_t TreeRevision = 0;
+
+    TickStats Stats;
+
+    uint64_t Tick = 0;
+    std::chrono::steady_clock::time_point Time;
+};
+
+// Ticks a BoidManager at a fixed rate on its own thread and publishes a
+// snapshot after every tick. While running the manager belongs to this
+// thread, anything else has to go through post().
+class SimulationThread {
+public:
+    using UpdateFunction = void ( BoidManager::* )();
+
+    SimulationThread( BoidManager& Manager_, const double TickRate = 60.0 );
+    ~SimulationThread();
+
+    SimulationThread( const SimulationThread& ) = delete;
+    SimulationThread& operator=( const SimulationThread& ) = delete;
+
+    void start();
+    void stop();
+    bool isRunning() const { return Running.load( std::memory_order_relaxed ); }
+
+    // Runs Command before the next tick, or right away when stopped
+    void post( std::function< void( BoidManager& ) > Command );
+
+    void setUpdate( const UpdateFunction Update_ );
+    // Only meaningful while stopped, a running thread may be switching
+    UpdateFunction getUpdate() const { return Update; }
+
+    // Hands every tick to Recorder_, nullptr to stop
+    void setRecorder( TrajectoryRecorder* Recorder_ );
+
+    // Newest published snapshot, nullptr before the first tick. Only call
+    // from the render thread.
+    const FlockSnapshot* acquire();
+
+    // How far into the tick after Snapshot the render clock is, 0 to 1
+    float getInterpolation( const FlockSnapshot& Snapshot ) const;
+
+private:
+    void run();
+    void runCommands();
+    void publish();
+
+    BoidManager& Manager;
+    UpdateFunction Update = &BoidManager::updateTree;
+    TrajectoryRecorder* Recorder = nullptr;
+
+    std::chrono::nanoseconds Period;
+
+    std::thread Worker;
+    std::atomic< bool > Running{ false };
+
+    std::mutex CommandMutex;
+    std::vector< std::function< void( BoidManager& ) > > Commands;
+    std::vector< std::function< void( BoidManager& ) > > PendingCommands;
+
+    TripleBuffer< FlockSnapshot > Snapshots;
+    uint64_t Ticks = 0;
+
+    bool HasSnapshot = false;
+};
+
+#endif
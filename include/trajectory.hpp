@@ -0,0 +1,122 @@
+#ifndef TRAJECTORY_HPP
+#define TRAJECTORY_HPP
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// On-disk layout written by TrajectoryRecorder. Little endian, a Header
+// followed by one chunk per recorded tick and, once recording stops, an index
+// with one IndexEntry per chunk and a Footer at the very end.
+//
+// Values are fixed point, positions in 1 / 2^PositionBits px and velocities
+// in 1 / 2^VelocityBits px per tick. Keyframes store them as zigzag varints.
+// Other chunks store the change from the previous chunk, positions relative
+// to where the new velocity would have carried them, which is almost always
+// a single byte.
+//
+// A chunk's payload starts with the uint32 byte size of each block of
+// BlockSize boids, followed by the blocks. Blocks decode independently, so a
+// large flock can be decoded on several threads.
+namespace Trajectory {
+
+constexpr std::array< char, 8 > Magic = { 'B', 'O', 'I', 'D', 'S',
+                                          'T', 'R', 'J' };
+constexpr std::array< char, 8 > IndexMagic = { 'B', 'O', 'I', 'D', 'S',
+                                               'I', 'D', 'X' };
+constexpr uint32_t Version = 2;
+constexpr size_t BlockSize = 1 << 14;
+
+// Bits of FrameHeader::Flags
+constexpr uint32_t FF_Keyframe = 1 << 0;
+
+struct Header {
+    std::array< char, 8 > Magic;
+    uint32_t Version;
+    uint32_t HeaderSize;
+
+    float BoundsX;
+    float BoundsY;
+    uint32_t PositionBits;
+    uint32_t VelocityBits;
+    uint32_t KeyframeInterval;
+    uint32_t Reserved;
+};
+
+struct FrameHeader {
+    uint64_t Tick;
+    uint32_t Count;
+    uint32_t Flags;
+    uint64_t PayloadSize;
+};
+
+struct IndexEntry {
+    // Byte offset of the chunk's FrameHeader
+    uint64_t Offset;
+    // Chunk to start decoding from to reach this one
+    uint64_t Keyframe;
+};
+
+struct Footer {
+    uint64_t IndexOffset;
+    uint64_t FrameCount;
+    std::array< char, 8 > Magic;
+};
+
+static_assert( std::is_trivially_copyable_v< Header > );
+static_assert( sizeof( Header ) % 8 == 0 && sizeof( FrameHeader ) % 8 == 0 &&
+                   sizeof( Footer ) % 8 == 0,
+               "Chunks should have no tail padding" );
+
+// One tick in fixed point, what both ends of the codec keep between chunks
+struct QuantisedFrame {
+    void resize( const size_t Count );
+    size_t size() const { return PositionX.size(); }
+
+    std::vector< int32_t > PositionX;
+    std::vector< int32_t > PositionY;
+    std::vector< int32_t > VelocityX;
+    std::vector< int32_t > VelocityY;
+};
+
+inline size_t getBlockCount( const size_t Count ) {
+    return ( Count + BlockSize - 1 ) / BlockSize;
+}
+
+void quantise( const float* PositionX, const float* PositionY,
+               const float* VelocityX, const float* VelocityY,
+               const size_t Count, const Header& Format,
+               QuantisedFrame& Frame );
+
+// Boids Begin to End of Frame
+void dequantise( const QuantisedFrame& Frame, const Header& Format,
+                 const size_t Begin, const size_t End, float* PositionX,
+                 float* PositionY, float* VelocityX, float* VelocityY );
+
+// Appends Current to Payload, as a delta when Previous is given. Previous
+// has to hold as many boids as Current.
+void encode( const QuantisedFrame& Current, const QuantisedFrame* Previous,
+             const Header& Format, std::vector< uint8_t >& Payload );
+
+// Reads the block table of a Count boid payload into Offsets, one more entry
+// than there are blocks. Fails when the sizes don't add up to Size.
+bool readBlocks( const uint8_t* Payload, const size_t Size,
+                 const size_t Count, std::vector< size_t >& Offsets );
+
+// Decodes one block over Frame, which has to be sized to the chunk already
+// and hold the previous chunk unless Keyframe is set
+bool decodeBlock( const uint8_t* Payload, const std::vector< size_t >& Offsets,
+                  const size_t Block, const bool Keyframe,
+                  const Header& Format, QuantisedFrame& Frame );
+
+// Every block on the calling thread. Fails on truncated or overlong payloads.
+bool decode( const uint8_t* Payload, const size_t Size, const size_t Count,
+             const bool Keyframe, const Header& Format,
+             QuantisedFrame& Frame );
+
+} // namespace Trajectory
+
+#endif
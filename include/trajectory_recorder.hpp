@@ -0,0 +1,97 @@
+#ifndef TRAJECTORY_RECORDER_HPP
+#define TRAJECTORY_RECORDER_HPP
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "boid_store.hpp"
+#include "trajectory.hpp"
+
+// Streams the flock to a trajectory file. record() only copies the boid
+// arrays into one of a fixed set of buffers; quantising, encoding and writing
+// happen on a background thread so the simulation never waits on the disk.
+// When the writer falls so far behind that every buffer is queued the tick is
+// dropped and counted instead.
+class TrajectoryRecorder {
+public:
+    explicit TrajectoryRecorder( const size_t BufferCount = 16 );
+    ~TrajectoryRecorder();
+
+    TrajectoryRecorder( const TrajectoryRecorder& ) = delete;
+    TrajectoryRecorder& operator=( const TrajectoryRecorder& ) = delete;
+
+    bool start( const std::string& Path, const Vector2& Bounds,
+                const uint32_t KeyframeInterval = 60 );
+    // Writes out everything already recorded, then the index
+    void stop();
+    bool isRecording() const {
+        return Recording.load( std::memory_order_relaxed );
+    }
+
+    // Call from the thread ticking the flock, between ticks. Safe against a
+    // stop() or start() from another thread.
+    bool record( const BoidStore& Store, const uint64_t Tick );
+
+    uint64_t getFrameCount() const { return Frames.load(); }
+    uint64_t getDroppedCount() const { return Dropped.load(); }
+    uint64_t getBytesWritten() const { return Bytes.load(); }
+
+private:
+    struct Buffer {
+        uint64_t Tick = 0;
+
+        std::vector< float > PositionX;
+        std::vector< float > PositionY;
+        std::vector< float > VelocityX;
+        std::vector< float > VelocityY;
+    };
+
+    void run();
+    void writeFrame( const Buffer& Frame );
+    void writeIndex();
+    void write( const void* Data, const size_t Size );
+
+    std::vector< Buffer > Buffers;
+
+    // Indices into Buffers, Queue is a ring of QueueSize entries at QueueHead
+    std::mutex Mutex;
+    std::condition_variable Wake;
+    std::vector< size_t > FreeBuffers;
+    std::vector< size_t > Queue;
+    size_t QueueHead = 0;
+    size_t QueueSize = 0;
+    bool Stopping = false;
+    // Buffers taken by record() and not queued yet, stop() waits on Settled
+    // for them
+    size_t InFlight = 0;
+    std::condition_variable Settled;
+
+    std::atomic< bool > Recording{ false };
+    std::thread Writer;
+
+    // Owned by the writer thread while recording
+    std::string Path;
+    std::ofstream File;
+    bool Failed = false;
+    uint64_t Offset = 0;
+    Trajectory::Header Format{};
+    Trajectory::QuantisedFrame Previous;
+    Trajectory::QuantisedFrame Current;
+    bool HasPrevious = false;
+    uint64_t LastKeyframe = 0;
+    std::vector< uint8_t > Payload;
+    std::vector< Trajectory::IndexEntry > Index;
+
+    std::atomic< uint64_t > Frames{ 0 };
+    std::atomic< uint64_t > Dropped{ 0 };
+    std::atomic< uint64_t > Bytes{ 0 };
+};
+
+#endif
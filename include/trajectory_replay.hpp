@@ -0,0 +1,78 @@
+#ifndef TRAJECTORY_REPLAY_HPP
+#define TRAJECTORY_REPLAY_HPP
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "boid_store.hpp"
+#include "mapped_file.hpp"
+#include "quadtree.hpp"
+#include "static_thread_pool.hpp"
+#include "trajectory.hpp"
+
+// Plays back a file written by TrajectoryRecorder without loading it. The
+// file stays mapped and seek() decodes from the nearest keyframe, so any
+// tick costs at most one keyframe interval of chunks wherever it is in the
+// file. Stepping forward one tick decodes a single chunk, its blocks spread
+// over a thread pool.
+class TrajectoryReplay {
+public:
+    // Recordings that were never stopped have no index, their chunks are
+    // scanned instead
+    bool open( const std::string& Path );
+    void close();
+    bool isOpen() const { return File.isOpen(); }
+
+    size_t getFrameCount() const { return Index.size(); }
+    // Tick the frame was recorded at
+    uint64_t getTick( const size_t Frame ) const;
+    Vector2 getBounds() const;
+
+    bool seek( const size_t Frame );
+    size_t getFrame() const { return Current; }
+
+    // The flock at getFrame()
+    const BoidStore& getStore() const { return Store; }
+    // Built on first use for each frame
+    const Quadtree& getQuadtree();
+
+private:
+    static constexpr size_t NoFrame = ~size_t{ 0 };
+
+    bool readIndex();
+    bool scanChunks();
+    bool readChunk( const size_t Offset, Trajectory::FrameHeader& Chunk,
+                    const uint8_t*& Payload ) const;
+    bool decodeFrame( const size_t Frame, const bool Last );
+    void decodeWorker( const size_t ThreadId );
+    void decodeBlocks( const size_t Worker, const size_t WorkerCount );
+    // Where the chunks end and the index begins
+    size_t getChunkEnd( const size_t Frame ) const;
+
+    MappedFile File;
+    Trajectory::Header Format{};
+    std::vector< Trajectory::IndexEntry > Index;
+    size_t DataEnd = 0;
+
+    std::unique_ptr< StaticThreadPool > Stp;
+
+    // The chunk being decoded, shared with the workers
+    const uint8_t* ChunkData = nullptr;
+    std::vector< size_t > Offsets;
+    bool Keyframe = false;
+    bool Last = false;
+    std::atomic< bool > Failed{ false };
+
+    Trajectory::QuantisedFrame Quantised;
+    BoidStore Store;
+    size_t Current = NoFrame;
+
+    Quadtree Tree;
+    size_t TreeFrame = NoFrame;
+};
+
+#endif
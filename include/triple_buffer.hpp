@@ -0,0 +1,47 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+#pragma once
+
+#include <array>
+#include <atomic>
+
+// Single writer, single reader hand-off without locks. The writer fills
+// getWriteBuffer() and publishes it, the reader swaps in the newest published
+// buffer with acquire(). Neither side ever waits on the other, a buffer the
+// reader has not picked up yet is simply replaced.
+template < typename T >
+class TripleBuffer {
+public:
+    T& getWriteBuffer() { return Buffers[Back]; }
+
+    void publish() {
+        Back = Middle.exchange( Back | FreshBit, std::memory_order_acq_rel ) &
+               IndexMask;
+    }
+
+    // Returns true when a newer buffer was swapped in
+    bool acquire() {
+        if ( ( Middle.load( std::memory_order_relaxed ) & FreshBit ) == 0 )
+            return false;
+
+        Front = Middle.exchange( Front, std::memory_order_acq_rel ) & IndexMask;
+        return true;
+    }
+
+    const T& getReadBuffer() const { return Buffers[Front]; }
+
+private:
+    static constexpr unsigned FreshBit = 4;
+    static constexpr unsigned IndexMask = 3;
+
+    std::array< T, 3 > Buffers{};
+
+    // Only touched by the writer
+    unsigned Back = 0;
+    // Only touched by the reader
+    unsigned Front = 2;
+
+    std::atomic< unsigned > Middle{ 1 };
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef WORK_STEALING_SCHEDULER_HPP
+#define WORK_STEALING_SCHEDULER_HPP
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Hands out chunks of an index range to the StaticThreadPool workers. Each
+// worker starts on its own contiguous run of chunks and, once that is done,
+// steals half of the remaining chunks of another worker. With per index
+// costs the chunks are cut to equal cost rather than equal length.
+class WorkStealingScheduler {
+public:
+    // Call before the task, Costs is indexed like the range and may be empty
+    void prepare( const size_t Count, const size_t WorkerCount,
+                  const std::vector< unsigned >& Costs );
+
+    // Call from every worker, Callback( Begin, End ) runs once per chunk
+    template < typename TCallback >
+    void run( const size_t Worker, TCallback&& Callback ) {
+        if ( Worker >= Workers ) return;
+
+        unsigned Chunk = 0;
+
+        while ( pop( Worker, Chunk ) || steal( Worker, Chunk ) ) {
+            Callback( ChunkStart[Chunk], ChunkStart[Chunk + 1] );
+        }
+    }
+
+    size_t getChunkCount() const {
+        return ChunkStart.empty() ? 0 : ChunkStart.size() - 1;
+    }
+
+    // Successful steals since the last prepare
+    size_t getStealCount() const {
+        return Steals.load( std::memory_order_relaxed );
+    }
+
+private:
+    bool pop( const size_t Worker, unsigned& Chunk );
+    bool steal( const size_t Worker, unsigned& Chunk );
+
+    static uint64_t pack( const unsigned Begin, const unsigned End ) {
+        return static_cast< uint64_t >( End ) << 32 | Begin;
+    }
+    static unsigned begin( const uint64_t Range ) {
+        return static_cast< unsigned >( Range );
+    }
+    static unsigned end( const uint64_t Range ) {
+        return static_cast< unsigned >( Range >> 32 );
+    }
+
+    // Remaining chunks [Begin, End) of one worker. The owner takes from the
+    // front, thieves cut from the back, both with a CAS on the same word.
+    struct alignas( 64 ) Queue {
+        std::atomic< uint64_t > Range{ 0 };
+    };
+
+    static const size_t ChunksPerWorker = 16;
+
+    std::vector< size_t > ChunkStart;
+    std::vector< uint64_t > CostPrefix;
+
+    std::unique_ptr< Queue[] > Queues;
+    size_t QueueCapacity = 0;
+    size_t Workers = 0;
+
+    std::atomic< size_t > Steals{ 0 };
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef ZONE_PROFILER_HPP
+#define ZONE_PROFILER_HPP
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Scoped timing zones for the hot paths. Each thread records into its own
+// ring buffer without locks, exportChromeTrace drains every buffer into a
+// file chrome://tracing or Perfetto can open. The BOIDS_ZONE macros compile
+// to nothing unless BOIDS_ENABLE_ZONES is defined.
+namespace ZoneProfiler {
+
+struct ZoneEvent {
+    const char* Name;
+    uint64_t Begin;
+    uint64_t End;
+};
+
+// Single producer, single consumer. The owning thread pushes, the exporter
+// drains. Events are dropped rather than overwritten when it is full.
+class ZoneBuffer {
+public:
+    static constexpr size_t Capacity = size_t( 1 ) << 15;
+
+    void push( const ZoneEvent& Event ) {
+        const size_t Write = Head.load( std::memory_order_relaxed );
+
+        if ( Write - Tail.load( std::memory_order_acquire ) == Capacity ) {
+            Dropped.fetch_add( 1, std::memory_order_relaxed );
+            return;
+        }
+
+        Events[Write & ( Capacity - 1 )] = Event;
+        Head.store( Write + 1, std::memory_order_release );
+    }
+
+    template < typename TCallback >
+    void drain( TCallback&& Callback ) {
+        const size_t Read = Tail.load( std::memory_order_relaxed );
+        const size_t Write = Head.load( std::memory_order_acquire );
+
+        for ( size_t i = Read; i < Write; ++i ) {
+            Callback( Events[i & ( Capacity - 1 )] );
+        }
+
+        Tail.store( Write, std::memory_order_release );
+    }
+
+    size_t takeDropped() {
+        return Dropped.exchange( 0, std::memory_order_relaxed );
+    }
+
+    std::string Name;
+
+private:
+    std::unique_ptr< ZoneEvent[] > Events =
+        std::make_unique< ZoneEvent[] >( Capacity );
+
+    alignas( 64 ) std::atomic< size_t > Head{ 0 };
+    alignas( 64 ) std::atomic< size_t > Tail{ 0 };
+    std::atomic< size_t > Dropped{ 0 };
+};
+
+inline uint64_t now() {
+    return static_cast< uint64_t >(
+        std::chrono::duration_cast< std::chrono::nanoseconds >(
+            std::chrono::steady_clock::now().time_since_epoch() )
+            .count() );
+}
+
+// Registers the calling thread on first use, buffers outlive their threads
+ZoneBuffer& getThreadBuffer();
+
+// Shown as the thread's name in the trace
+void setThreadName( std::string Name );
+
+// Writes every event recorded since the last export, returns false if the
+// file could not be written
+bool exportChromeTrace( const std::string& Path );
+
+class ScopedZone {
+public:
+    explicit ScopedZone( const char* Name_ ) : Name( Name_ ), Begin( now() ) {}
+    ~ScopedZone() { getThreadBuffer().push( ZoneEvent{ Name, Begin, now() } ); }
+
+    ScopedZone( const ScopedZone& ) = delete;
+    ScopedZone& operator=( const ScopedZone& ) = delete;
+
+private:
+    const char* Name;
+    uint64_t Begin;
+};
+
+} // namespace ZoneProfiler
+
+#define BOIDS_ZONE_CONCAT_( A, B ) A##B
+#define BOIDS_ZONE_CONCAT( A, B ) BOIDS_ZONE_CONCAT_( A, B )
+
+#ifdef BOIDS_ENABLE_ZONES
+// Name has to outlive the export, use string literals
+#define BOIDS_ZONE( Name )                                                     \
+    ZoneProfiler::ScopedZone BOIDS_ZONE_CONCAT( Zone, __LINE__ )( Name )
+// Name is only evaluated the first time each thread gets here
+#define BOIDS_ZONE_THREAD( Name )                                              \
+    do {                                                                       \
+        static thread_local bool Named = false;                                \
+        if ( !Named ) {                                                        \
+            ZoneProfiler::setThreadName( Name );                               \
+            Named = true;                                                      \
+        }                                                                      \
+    } while ( false )
+#else
+#define BOIDS_ZONE( Name ) static_cast< void >( 0 )
+#define BOIDS_ZONE_THREAD( Name ) static_cast< void >( 0 )
+#endif
+
+#endif
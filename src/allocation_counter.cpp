@@ -0,0 +1,110 @@
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "allocation_counter.hpp"
+
+#ifdef BOIDS_COUNT_ALLOCATIONS
+
+namespace {
+
+std::atomic< uint64_t > Allocations{ 0 };
+std::atomic< uint64_t > Deallocations{ 0 };
+
+void* allocate( std::size_t Size ) {
+    Allocations.fetch_add( 1, std::memory_order_relaxed );
+
+    if ( Size == 0 ) Size = 1;
+
+    if ( void* Ptr = std::malloc( Size ) ) return Ptr;
+    throw std::bad_alloc();
+}
+
+void* allocateAligned( std::size_t Size, const std::align_val_t Alignment ) {
+    Allocations.fetch_add( 1, std::memory_order_relaxed );
+
+    const auto Align = static_cast< std::size_t >( Alignment );
+
+    // aligned_alloc wants a multiple of the alignment
+    Size = ( std::max< std::size_t >( Size, 1 ) + Align - 1 ) & ~( Align - 1 );
+
+#ifdef _MSC_VER
+    void* Ptr = _aligned_malloc( Size, Align );
+#else
+    void* Ptr = std::aligned_alloc( Align, Size );
+#endif
+
+    if ( Ptr ) return Ptr;
+    throw std::bad_alloc();
+}
+
+void release( void* Ptr ) {
+    if ( Ptr == nullptr ) return;
+
+    Deallocations.fetch_add( 1, std::memory_order_relaxed );
+    std::free( Ptr );
+}
+
+void releaseAligned( void* Ptr ) {
+    if ( Ptr == nullptr ) return;
+
+    Deallocations.fetch_add( 1, std::memory_order_relaxed );
+
+#ifdef _MSC_VER
+    _aligned_free( Ptr );
+#else
+    std::free( Ptr );
+#endif
+}
+
+} // namespace
+
+bool AllocationCounter::isEnabled() { return true; }
+
+uint64_t AllocationCounter::getAllocations() {
+    return Allocations.load( std::memory_order_relaxed );
+}
+
+uint64_t AllocationCounter::getDeallocations() {
+    return Deallocations.load( std::memory_order_relaxed );
+}
+
+void* operator new( std::size_t Size ) { return allocate( Size ); }
+void* operator new[]( std::size_t Size ) { return allocate( Size ); }
+
+void* operator new( std::size_t Size, const std::align_val_t Alignment ) {
+    return allocateAligned( Size, Alignment );
+}
+void* operator new[]( std::size_t Size, const std::align_val_t Alignment ) {
+    return allocateAligned( Size, Alignment );
+}
+
+void operator delete( void* Ptr ) noexcept { release( Ptr ); }
+void operator delete[]( void* Ptr ) noexcept { release( Ptr ); }
+void operator delete( void* Ptr, std::size_t ) noexcept { release( Ptr ); }
+void operator delete[]( void* Ptr, std::size_t ) noexcept { release( Ptr ); }
+
+void operator delete( void* Ptr, std::align_val_t ) noexcept {
+    releaseAligned( Ptr );
+}
+void operator delete[]( void* Ptr, std::align_val_t ) noexcept {
+    releaseAligned( Ptr );
+}
+void operator delete( void* Ptr, std::size_t, std::align_val_t ) noexcept {
+    releaseAligned( Ptr );
+}
+void operator delete[]( void* Ptr, std::size_t, std::align_val_t ) noexcept {
+    releaseAligned( Ptr );
+}
+
+#else
+
+bool AllocationCounter::isEnabled() { return false; }
+
+uint64_t AllocationCounter::getAllocations() { return 0; }
+
+uint64_t AllocationCounter::getDeallocations() { return 0; }
+
+#endif
@@ -6,17 +6,10 @@
 #include <fmt/core.h>
 #include "trace.hpp"
 
-Boid::Boid( const Vector2& Position_, const float Scale_ )
-    : Position( Position_ ), Scale( Scale_ ) {}
+Boid::Boid( const float Scale_, const float SimScale_ )
+    : Scale( Scale_ ), SimScale( SimScale_ ) {}
 
-Boid::Boid( const Vector2& Position_, const Vector2& Velocity_,
-            const float Scale_, const float SimScale_, const size_t Id_ )
-    : Position( Position_ ), Velocity( Velocity_ ), Scale( Scale_ ),
-      SimScale( SimScale_ ), Id( Id_ ) {}
-
-void Boid::update() {}
-
-void Boid::draw() const {
+void Boid::draw( const Vector2& Position, const Vector2& Velocity ) const {
     const float Angle = Vector2Angle( Fwd, Velocity );
 
     DrawRectangleLines( static_cast< int >( Position.x - ( 50.f * SimScale ) ),
@@ -37,7 +30,8 @@ void Boid::draw() const {
         GREEN );
 }
 
-const Vector2 Boid::boundPosition( const Vector2& Bounds ) const {
+const Vector2 Boid::boundPosition( const Vector2& Position,
+                                   const Vector2& Bounds ) const {
     Vector2 Result( 0.f );
 
     if ( Position.x < 0.f )
@@ -52,12 +46,3 @@ const Vector2 Boid::boundPosition( const Vector2& Bounds ) const {
 
     return Result;
 }
-
-void Boid::setVelocity( const Vector2& Velocity_ ) { Velocity = Velocity_; }
-void Boid::setPosition( const Vector2& Position_ ) { Position = Position_; }
-
-const Vector2& Boid::getPosition() const { return Position; }
-
-const Vector2& Boid::getVelocity() const { return Velocity; }
-
-const size_t Boid::getId() const { return Id; }
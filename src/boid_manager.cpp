@@ -1,354 +1,1210 @@
 
 #include "boid_manager.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
 #include <numeric>
+#include <string>
 
 #include "raymath.h"
 
+#include "allocation_counter.hpp"
+#include "checkpoint.hpp"
+#include "mapped_file.hpp"
+#include "morton.hpp"
+#include "neighbour_kernel.hpp"
+#include "timer.hpp"
+#include "zone_profiler.hpp"
+
 #include <fmt/core.h>
 #include "trace.hpp"
 
-BoidManager::BoidManager( const Vector2 Bounds_ ) : Bounds( Bounds_ ) {
-    const float Scale = LocalSize / 13.f;
+BoidManager::BoidManager( const Vector2 Bounds_, const size_t Count,
+                          const unsigned Seed_ )
+    : Bounds( Bounds_ ), Seed( Seed_ ) {
+    if ( Seed != 0 ) SetRandomSeed( Seed );
 
     LocalSize *= SimScale;
     SpeedLimit *= SimScale;
 
+    Prototype = std::make_unique< Boid >( makePrototype() );
+
     QInstance = std::make_unique< Quadtree >();
+    Grid = std::make_unique< CellGrid >();
 
     Stp = std::make_unique< StaticThreadPool >();
     ThreadCount = Stp->getThreadCount();
+    ActiveThreads = ThreadCount;
+    ThreadLoads.resize( ThreadCount );
+    TickBusy.resize( ThreadCount );
+    VerletChunks.resize( ThreadCount );
+    Arenas.resize( ThreadCount );
 
     Stp->initialize( &BoidManager::updateThreadWorker, this );
 
-    // Vector2 Positions[2] = { Vector2( 10.f, 10.f ),
-    //                          Vector2( Bounds.x - 10.f, Bounds.y - 10.f ) };
+    Store.reserve( Count );
+    Slots.reserve( Count );
 
-    for ( size_t i = 0; i < MAX; ++i ) {
+    for ( size_t i = 0; i < Count; ++i ) {
         const Vector2 Pos( static_cast< float >( GetRandomValue(
                                0, static_cast< int >( Bounds.x ) ) ),
                            static_cast< float >( GetRandomValue(
                                0, static_cast< int >( Bounds.y ) ) ) );
 
-        // const Vector2 Pos = Positions[i];
-
-        // const Vector2 Vel( 0.f );
         const Vector2 Vel( static_cast< float >( GetRandomValue( -5, 5 ) ),
                            static_cast< float >( GetRandomValue( -5, 5 ) ) );
 
-        BoidList[i] = std::make_unique< Boid >( Pos, Vel, Scale, SimScale, i );
+        spawn( Pos, Vel );
     }
 }
 
-void BoidManager::buildTree() {
+size_t BoidManager::spawn( const Vector2& Position, const Vector2& Velocity ) {
+    size_t Id = Slots.size();
+
+    if ( !FreeIds.empty() ) {
+        Id = FreeIds.back();
+        FreeIds.pop_back();
+    } else {
+        Slots.push_back( InvalidSlot );
+    }
+
+    const size_t Slot = Store.size();
+
+    Store.push( Position, Velocity, Id );
+    Slots[Id] = Slot;
+
+    if ( NeighbourCosts.size() == Slot ) NeighbourCosts.push_back( 1 );
+    VerletValid = false;
+
+    // Boids outside the current root wait for the next rebuild
+    if ( QInstance->contains( Position ) ) QInstance->insert( Store, Slot );
+
+    return Id;
+}
+
+bool BoidManager::despawn( const size_t Id ) {
+    if ( Id >= Slots.size() || Slots[Id] == InvalidSlot ) return false;
+
+    const size_t Slot = Slots[Id];
+    const size_t Last = Store.size() - 1;
+
+    QInstance->remove( Slot );
+    // The grid is rebuilt every tick, drop it rather than patch it
+    Grid->clear();
+
+    Store.swapRemove( Slot );
+
+    if ( NeighbourCosts.size() == Last + 1 ) {
+        NeighbourCosts[Slot] = NeighbourCosts[Last];
+        NeighbourCosts.pop_back();
+    }
+
+    if ( Slot != Last ) {
+        QInstance->move( Last, Slot );
+        Slots[Store.Ids[Slot]] = Slot;
+    }
+
+    Slots[Id] = InvalidSlot;
+    FreeIds.push_back( Id );
+
+    VerletValid = false;
+
+    return true;
+}
+
+void BoidManager::dropCaches() {
     QInstance->clear();
-    QInstance->initialize( BoidList );
+    Grid->clear();
 
-    for ( auto& ThisBoid : BoidList ) {
-        QInstance->insert( ThisBoid.get() );
+    TicksSinceRebuild = 0;
+    VerletValid = false;
+}
+
+bool BoidManager::saveCheckpoint( const std::string& Path ) {
+    std::ofstream File( Path, std::ios::binary | std::ios::trunc );
+
+    if ( !File ) {
+        Trace::message(
+            fmt::format( "{:>24}: could not open {}", "Checkpoint", Path ) );
+        return false;
+    }
+
+    const size_t Count = Store.size();
+
+    Checkpoint::Header Header{};
+    Header.Magic = Checkpoint::Magic;
+    Header.Version = Checkpoint::Version;
+    Header.HeaderSize = sizeof( Checkpoint::Header );
+
+    Header.Count = Count;
+    Header.SlotCount = Slots.size();
+    Header.FreeIdCount = FreeIds.size();
+    Header.Tick = Stats.Tick;
+
+    Header.Seed = Seed;
+    Header.Backend = static_cast< uint32_t >( Backend );
+    Header.Flags =
+        ( ApproximateTree ? Checkpoint::F_ApproximateTree : 0 ) |
+        ( IncrementalTree ? Checkpoint::F_IncrementalTree : 0 ) |
+        ( ParallelTreeBuild ? Checkpoint::F_ParallelTreeBuild : 0 ) |
+        ( DoubleBuffered ? Checkpoint::F_DoubleBuffered : 0 ) |
+        ( VerletLists ? Checkpoint::F_VerletLists : 0 ) |
+        ( WorkStealing ? Checkpoint::F_WorkStealing : 0 ) |
+        ( Topological ? Checkpoint::F_Topological : 0 );
+    Header.SortInterval = static_cast< uint32_t >( SortInterval );
+    Header.TicksSinceSort = static_cast< uint32_t >( TicksSinceSort );
+    Header.TreeRebuildInterval = static_cast< uint32_t >( TreeRebuildInterval );
+
+    Header.BoundsX = Bounds.x;
+    Header.BoundsY = Bounds.y;
+    Header.LocalSize = LocalSize;
+    Header.SpeedLimit = SpeedLimit;
+    Header.SimScale = SimScale;
+    Header.Theta = QInstance->getTheta();
+    Header.VerletSkin = VerletSkin;
+    Header.TopologicalCount = static_cast< uint32_t >( TopologicalCount );
+
+    // Lay the arrays out first, then write the header that points at them
+    uint64_t Offset = sizeof( Checkpoint::Header );
+    const auto place = [&Offset]( const size_t Bytes ) {
+        Offset = ( Offset + Checkpoint::Alignment - 1 ) &
+                 ~( Checkpoint::Alignment - 1 );
+
+        const uint64_t Start = Offset;
+        Offset += Bytes;
+        return Start;
+    };
+
+    Header.PositionX = place( Count * sizeof( float ) );
+    Header.PositionY = place( Count * sizeof( float ) );
+    Header.VelocityX = place( Count * sizeof( float ) );
+    Header.VelocityY = place( Count * sizeof( float ) );
+    Header.Ids = place( Count * sizeof( uint64_t ) );
+    Header.FreeIds = place( FreeIds.size() * sizeof( uint64_t ) );
+
+    File.write( reinterpret_cast< const char* >( &Header ), sizeof( Header ) );
+
+    uint64_t Written = sizeof( Checkpoint::Header );
+    const auto write = [&File, &Written]( const uint64_t At, const void* Data,
+                                          const size_t Bytes ) {
+        static constexpr char Zeros[Checkpoint::Alignment] = {};
+        File.write( Zeros, static_cast< std::streamsize >( At - Written ) );
+        File.write( static_cast< const char* >( Data ),
+                    static_cast< std::streamsize >( Bytes ) );
+        Written = At + Bytes;
+    };
+
+    static_assert( sizeof( size_t ) == sizeof( uint64_t ),
+                   "Ids are written as they are stored" );
+
+    write( Header.PositionX, Store.PositionX.data(), Count * sizeof( float ) );
+    write( Header.PositionY, Store.PositionY.data(), Count * sizeof( float ) );
+    write( Header.VelocityX, Store.VelocityX.data(), Count * sizeof( float ) );
+    write( Header.VelocityY, Store.VelocityY.data(), Count * sizeof( float ) );
+    write( Header.Ids, Store.Ids.data(), Count * sizeof( uint64_t ) );
+    write( Header.FreeIds, FreeIds.data(),
+           FreeIds.size() * sizeof( uint64_t ) );
+
+    if ( !File ) {
+        Trace::message(
+            fmt::format( "{:>24}: failed writing {}", "Checkpoint", Path ) );
+        return false;
     }
+
+    dropCaches();
+
+    Trace::message( fmt::format( "{:>24}: {} boids at tick {} to {}",
+                                 "Checkpoint saved", Count, Stats.Tick,
+                                 Path ) );
+    return true;
 }
 
-void BoidManager::updateTreeThread() {
-    buildTree();
+bool BoidManager::loadCheckpoint( const std::string& Path ) {
+    const auto fail = [&Path]( const char* Reason ) {
+        Trace::message( fmt::format( "{:>24}: {}, {}", "Checkpoint not loaded",
+                                     Path, Reason ) );
+        return false;
+    };
+
+    MappedFile File;
+    if ( !File.open( Path ) ) return fail( "could not map the file" );
+
+    const auto* Header = File.get< Checkpoint::Header >( 0 );
+    if ( Header == nullptr || Header->Magic != Checkpoint::Magic )
+        return fail( "not a checkpoint" );
+    if ( Header->Version != Checkpoint::Version ||
+         Header->HeaderSize != sizeof( Checkpoint::Header ) )
+        return fail( "unsupported version" );
+    if ( Header->SimScale != SimScale ) return fail( "different SimScale" );
+    if ( Header->Backend > B_CellGrid ) return fail( "unknown backend" );
+
+    const size_t Count = Header->Count;
+    const size_t FreeCount = Header->FreeIdCount;
+
+    const float* PositionX = File.get< float >( Header->PositionX, Count );
+    const float* PositionY = File.get< float >( Header->PositionY, Count );
+    const float* VelocityX = File.get< float >( Header->VelocityX, Count );
+    const float* VelocityY = File.get< float >( Header->VelocityY, Count );
+    const uint64_t* Ids = File.get< uint64_t >( Header->Ids, Count );
+    const uint64_t* Free = File.get< uint64_t >( Header->FreeIds, FreeCount );
+
+    if ( !PositionX || !PositionY || !VelocityX || !VelocityY || !Ids ||
+         ( FreeCount > 0 && !Free ) || Count + FreeCount != Header->SlotCount )
+        return fail( "truncated or inconsistent" );
+
+    // Every id has to be either live exactly once or free
+    std::vector< size_t > NewSlots( Header->SlotCount, InvalidSlot );
+
+    for ( size_t i = 0; i < Count; ++i ) {
+        if ( Ids[i] >= NewSlots.size() || NewSlots[Ids[i]] != InvalidSlot )
+            return fail( "corrupt ids" );
+        NewSlots[Ids[i]] = i;
+    }
 
-    UStatus = S_Velocity;
-    Stp->runTask();
+    for ( size_t i = 0; i < FreeCount; ++i ) {
+        if ( Free[i] >= NewSlots.size() || NewSlots[Free[i]] != InvalidSlot )
+            return fail( "corrupt ids" );
+    }
 
-    UStatus = S_Position;
-    Stp->runTask();
+    Store.resize( Count );
+    std::memcpy( Store.PositionX.data(), PositionX, Count * sizeof( float ) );
+    std::memcpy( Store.PositionY.data(), PositionY, Count * sizeof( float ) );
+    std::memcpy( Store.VelocityX.data(), VelocityX, Count * sizeof( float ) );
+    std::memcpy( Store.VelocityY.data(), VelocityY, Count * sizeof( float ) );
+    std::memcpy( Store.Ids.data(), Ids, Count * sizeof( uint64_t ) );
+
+    Slots = std::move( NewSlots );
+    FreeIds.assign( Free, Free + FreeCount );
+
+    Seed = Header->Seed;
+    if ( Seed != 0 ) SetRandomSeed( Seed );
+
+    Bounds = Vector2{ Header->BoundsX, Header->BoundsY };
+    LocalSize = Header->LocalSize;
+    SpeedLimit = Header->SpeedLimit;
+    QInstance->setTheta( Header->Theta );
+    VerletSkin = Header->VerletSkin;
+
+    Backend = static_cast< NeighbourBackend >( Header->Backend );
+    ApproximateTree = Header->Flags & Checkpoint::F_ApproximateTree;
+    ParallelTreeBuild = Header->Flags & Checkpoint::F_ParallelTreeBuild;
+    DoubleBuffered = Header->Flags & Checkpoint::F_DoubleBuffered;
+    VerletLists = Header->Flags & Checkpoint::F_VerletLists;
+    WorkStealing = Header->Flags & Checkpoint::F_WorkStealing;
+    // Older checkpoints left the count zero
+    setTopological( Header->Flags & Checkpoint::F_Topological,
+                    Header->TopologicalCount != 0 ? Header->TopologicalCount
+                                                  : 7 );
+
+    SortInterval = Header->SortInterval;
+    TicksSinceSort = Header->TicksSinceSort;
+    setIncrementalTree( Header->Flags & Checkpoint::F_IncrementalTree,
+                        Header->TreeRebuildInterval );
+
+    NeighbourCosts.assign( Count, 1 );
+    Stats = TickStats{};
+    Stats.Tick = Header->Tick;
+
+    dropCaches();
+
+    Trace::message( fmt::format( "{:>24}: {} boids at tick {} from {}",
+                                 "Checkpoint loaded", Count, Stats.Tick,
+                                 Path ) );
+    return true;
 }
 
-void BoidManager::updateTree() {
-    buildTree();
+void BoidManager::beginTick() {
+    TickStart = std::chrono::steady_clock::now();
+    TickAllocations = AllocationCounter::getAllocations();
+    TickPhaseSeconds = PhaseSeconds;
 
-    for ( size_t i = 0; i < MAX; ++i ) {
-        auto* ThisBoid = BoidList[i].get();
+    for ( size_t t = 0; t < ThreadCount; ++t ) {
+        TickBusy[t] = ThreadLoads[t].Busy;
+    }
 
-        auto Targets =
-            QInstance->query( ThisBoid->getPosition(), LocalSize / 2.f );
+    Stats.IndexMs = 0.f;
+    Stats.VelocityMs = 0.f;
+    Stats.PositionMs = 0.f;
 
-        BoidsUpdateValues Values;
-        // Trace::message( fmt::format( "Boid#{} Targets:", ThisBoid->getId() ) );
-        for ( auto* OtherBoid : Targets ) {
-            if ( OtherBoid == ThisBoid ) continue;
-            // Trace::message( fmt::format( "\t\tBoid#{}", OtherBoid->getId() ) );
-
-            Values.Count += 1;
-            Values.AvgVelocity =
-                Vector2Add( Values.AvgVelocity, OtherBoid->getVelocity() );
-            Values.AvgPosition =
-                Vector2Add( Values.AvgPosition, OtherBoid->getPosition() );
-
-            const float Distance = Vector2Distance( ThisBoid->getPosition(),
-                                                    OtherBoid->getPosition() );
-
-            // Trace::message( fmt::format( "\t\tBoid#{}: Distance: {}",
-                                        //  OtherBoid->getId(), Distance ) );
-
-            if ( Distance < ( LocalSize * 0.4f ) ) {
-                Values.AvgAvoid = Vector2Subtract(
-                    Values.AvgAvoid,
-                    Vector2Scale( Vector2Normalize( Vector2Subtract(
-                                      OtherBoid->getPosition(),
-                                      ThisBoid->getPosition() ) ),
-                                  10.f / Clamp( Distance, 0.001f, 100.f ) ) );
-            }
+    for ( BumpArena& Arena : Arenas ) {
+        Arena.reset();
+    }
+
+    if ( NeighbourCosts.size() != Store.size() )
+        NeighbourCosts.assign( Store.size(), 1 );
+
+    if ( SortInterval == 0 ) return;
+
+    TicksSinceSort += 1;
+    if ( TicksSinceSort < SortInterval ) return;
+
+    TicksSinceSort = 0;
+    sortBoids();
+}
+
+void BoidManager::endTick() {
+    const auto End = std::chrono::steady_clock::now();
+
+    Stats.Tick += 1;
+    Stats.Count = Store.size();
+    Stats.TotalMs = static_cast< float >(
+        std::chrono::duration< double, std::milli >( End - TickStart )
+            .count() );
+    Stats.Allocations.reset();
+    if ( AllocationCounter::isEnabled() )
+        Stats.Allocations =
+            AllocationCounter::getAllocations() - TickAllocations;
+
+    Stats.NodeCount = 0;
+    Stats.TreeDepth = 0;
+    Stats.NodeHighWater = 0;
+    if ( Backend == B_Quadtree ) {
+        Stats.NodeCount = QInstance->countNodes( Stats.TreeDepth );
+        Stats.NodeHighWater = QInstance->getNodeStats().HighWater;
+    }
+
+    // NeighbourCosts holds this tick's counts plus one
+    unsigned Most = 0;
+    size_t Total = 0;
+    for ( const unsigned Cost : NeighbourCosts ) {
+        Most = std::max( Most, Cost - 1 );
+        Total += Cost - 1;
+    }
+
+    Stats.NeighbourMean =
+        NeighbourCosts.empty()
+            ? 0.f
+            : static_cast< float >( Total ) /
+                  static_cast< float >( NeighbourCosts.size() );
+
+    const size_t Buckets = Stats.NeighbourHistogram.size();
+    Stats.BucketWidth =
+        std::max( 1u, ( Most + 1 + static_cast< unsigned >( Buckets ) - 1 ) /
+                          static_cast< unsigned >( Buckets ) );
+    Stats.NeighbourHistogram.fill( 0 );
+
+    for ( const unsigned Cost : NeighbourCosts ) {
+        const size_t Bucket = ( Cost - 1 ) / Stats.BucketWidth;
+        Stats.NeighbourHistogram[std::min( Bucket, Buckets - 1 )] += 1;
+    }
+
+    const double Phases = PhaseSeconds - TickPhaseSeconds;
+
+    Stats.Utilisation.resize( ActiveThreads );
+    for ( size_t t = 0; t < ActiveThreads; ++t ) {
+        Stats.Utilisation[t] =
+            Phases > 0.0 ? static_cast< float >(
+                               ( ThreadLoads[t].Busy - TickBusy[t] ) / Phases )
+                         : 0.f;
+    }
+}
+
+void BoidManager::sortBoids() {
+    const size_t Count = Store.size();
+    if ( Count < 2 ) return;
+
+    const auto reorder = [&]() {
+        Vector2 Min = Vector2{ std::numeric_limits< float >::max(),
+                               std::numeric_limits< float >::max() };
+        Vector2 Max = Vector2{ std::numeric_limits< float >::lowest(),
+                               std::numeric_limits< float >::lowest() };
+
+        for ( size_t i = 0; i < Count; ++i ) {
+            Min.x = std::min( Min.x, Store.PositionX[i] );
+            Min.y = std::min( Min.y, Store.PositionY[i] );
+            Max.x = std::max( Max.x, Store.PositionX[i] );
+            Max.y = std::max( Max.y, Store.PositionY[i] );
         }
 
-        if ( Values.Count > 0 ) {
-            Values.AvgVelocity = Vector2Scale( Values.AvgVelocity,
-                                               1.f / ( Values.Count * 8.f ) );
+        // Quantise onto a 16 bit grid per axis
+        const float Extent =
+            std::max( std::max( Max.x - Min.x, Max.y - Min.y ), 1.f );
+        const float Quantise = 65535.f / Extent;
 
-            Values.AvgPosition =
-                Vector2Scale( Values.AvgPosition, 1.f / Values.Count );
-            Values.AvgPosition =
-                Vector2Subtract( Values.AvgPosition, ThisBoid->getPosition() );
-            Values.AvgPosition =
-                Vector2Scale( Values.AvgPosition, 1.f / 100.f );
+        SortKeys.resize( Count );
+        SortOrder.resize( Count );
 
-            Values.AvgVelocity = Vector2Scale( Values.AvgVelocity, SimScale );
-            Values.AvgPosition = Vector2Scale( Values.AvgPosition, SimScale );
-            Values.AvgAvoid = Vector2Scale( Values.AvgAvoid, SimScale );
+        for ( size_t i = 0; i < Count; ++i ) {
+            const auto X = static_cast< uint32_t >(
+                ( Store.PositionX[i] - Min.x ) * Quantise );
+            const auto Y = static_cast< uint32_t >(
+                ( Store.PositionY[i] - Min.y ) * Quantise );
+
+            SortKeys[i] = Morton::encode( X, Y );
+            SortOrder[i] = static_cast< unsigned >( i );
         }
 
-        ThisBoid->setVelocity( Vector2Add(
-            ThisBoid->getVelocity(),
-            Vector2Add( Values.AvgVelocity,
-                        Vector2Add( Values.AvgPosition,
-                                    Vector2Add( Values.AvgAvoid,
-                                                ThisBoid->boundPosition(
-                                                    Bounds ) ) ) ) ) );
-
-        if ( Vector2Length( ThisBoid->getVelocity() ) > SpeedLimit ) {
-            ThisBoid->setVelocity( Vector2Scale(
-                Vector2Normalize( ThisBoid->getVelocity() ), SpeedLimit ) );
+        Morton::radixSort( SortKeys, SortOrder, SortKeyScratch,
+                           SortOrderScratch );
+
+        Store.reorder( SortOrder, SortScratch );
+
+        if ( NeighbourCosts.size() == Count ) {
+            SortKeyScratch.resize( Count );
+            for ( size_t i = 0; i < Count; ++i ) {
+                SortKeyScratch[i] = NeighbourCosts[SortOrder[i]];
+            }
+            NeighbourCosts.assign( SortKeyScratch.begin(),
+                                   SortKeyScratch.begin() + Count );
+        }
+
+        for ( size_t i = 0; i < Count; ++i ) {
+            Slots[Store.Ids[i]] = i;
+        }
+
+        // Slots moved, the indices are rebuilt before they are used again
+        QInstance->clear();
+        Grid->clear();
+        VerletValid = false;
+    };
+
+    if ( !ReportSortLocality ) {
+        reorder();
+        return;
+    }
+
+    const float Before = measureLocality();
+
+    Timer SortTimer;
+    SortTimer.run( "Morton sort", reorder );
+
+    const float After = measureLocality();
+
+    Trace::message( fmt::format(
+        "{:>24}: {:.2f} -> {:.2f} cache lines per neighbourhood "
+        "({:.1f}% fewer)",
+        "Morton locality", Before, After,
+        Before > 0.f ? ( 1.f - After / Before ) * 100.f : 0.f ) );
+}
+
+// Average number of distinct 64 byte lines of PositionX touched while visiting
+// the neighbours of a sample of boids, a proxy for cache misses per boid
+float BoidManager::measureLocality() const {
+    const size_t Count = Store.size();
+    if ( Count == 0 ) return 0.f;
+
+    CellGrid SampleGrid;
+    SampleGrid.build( Store, LocalSize );
+
+    const size_t SampleCount = std::min< size_t >( Count, 256 );
+    const size_t Step = Count / SampleCount;
+    const size_t FloatsPerLine = 64 / sizeof( float );
+
+    size_t Lines = 0;
+    BumpArena Arena;
+
+    for ( size_t s = 0; s < SampleCount; ++s ) {
+        BumpArena::Scope Scope( Arena );
+
+        const auto Targets =
+            SampleGrid.query( Store.getPosition( s * Step ), LocalSize, Arena );
+
+        for ( auto& Target : Targets ) {
+            Target /= FloatsPerLine;
         }
+
+        std::sort( Targets.begin(), Targets.end() );
+        Lines += static_cast< size_t >(
+            std::unique( Targets.begin(), Targets.end() ) - Targets.begin() );
     }
 
-    for ( size_t i = 0; i < MAX; ++i ) {
-        auto& ThisBoid = BoidList[i];
+    return static_cast< float >( Lines ) / SampleCount;
+}
+
+void BoidManager::buildTree() {
+    BOIDS_ZONE( "Build tree" );
+
+    if ( IncrementalTree ) {
+        TicksSinceRebuild += 1;
 
-        ThisBoid->setPosition(
-            Vector2Add( ThisBoid->getPosition(), ThisBoid->getVelocity() ) );
+        if ( TicksSinceRebuild < TreeRebuildInterval &&
+             QInstance->update( Store ) )
+            return;
+
+        TicksSinceRebuild = 0;
+    }
+
+    if ( !ParallelTreeBuild ) {
+        QInstance->build( Store );
+        return;
     }
+
+    QInstance->beginBuild( Store, ActiveThreads );
+
+    runPhase( S_BuildTree );
+
+    QInstance->allocateTasks();
+
+    runPhase( S_StitchTree );
 }
 
-void BoidManager::updateThread() {
+void BoidManager::buildSpatialIndex() {
+    if ( Backend == B_CellGrid ) {
+        BOIDS_ZONE( "Build grid" );
+        Grid->build( Store, LocalSize );
+    } else {
+        buildTree();
 
-    // buildTree();
+        if ( ApproximateTree && !Topological )
+            QInstance->computeAggregates( Store );
+    }
+}
 
-    UStatus = S_Velocity;
-    Stp->runTask();
+void BoidManager::setIncrementalTree( const bool Incremental,
+                                      const size_t RebuildInterval ) {
+    IncrementalTree = Incremental;
+    TreeRebuildInterval = RebuildInterval;
+    TicksSinceRebuild = 0;
 
-    UStatus = S_Position;
-    Stp->runTask();
+    // Leave enough room that no boid can outrun the root between rebuilds
+    QInstance->setRootPadding(
+        Incremental ? SpeedLimit * static_cast< float >( RebuildInterval )
+                    : 0.f );
+    QInstance->clear();
 }
 
-void BoidManager::updateTreeThreadWorker( const size_t ThreadId ) {
-    const size_t Stride = MAX / ThreadCount;
+void BoidManager::setActiveThreads( const size_t Threads ) {
+    ActiveThreads = std::clamp< size_t >( Threads, 1, ThreadCount );
+}
 
-    const size_t Start = ThreadId * Stride;
+void BoidManager::setNeighbourBackend( const NeighbourBackend Backend_ ) {
+    if ( Backend == Backend_ ) return;
 
-    size_t End = ( ThreadId + 1 ) * Stride;
-    if ( ThreadId == ThreadCount - 1 ) End = MAX;
+    Backend = Backend_;
 
-    if ( UStatus == S_Velocity ) {
-        for ( size_t i = Start; i < End; ++i ) {
-            auto& Boid1 = BoidList[i];
-
-            Vector2 AvgPosition( 0.f ); // Cohesion
-            Vector2 AvgVelocity( 0.f ); // Alignment
-            Vector2 AvgAvoid( 0.f );    // Seperation
-            size_t Count = 0;
-
-            for ( auto& Boid2 : BoidList ) {
-                const float Distance = Vector2Distance( Boid1->getPosition(),
-                                                        Boid2->getPosition() );
-                if ( Distance >= LocalSize ) continue;
-
-                Count += 1;
-                // Alignment
-                AvgVelocity = Vector2Add( AvgVelocity, Boid2->getVelocity() );
-                // Cohesion
-                AvgPosition = Vector2Add( AvgPosition, Boid2->getPosition() );
-                // Separation
-                if ( Distance >= LocalSize * 0.4f ) continue;
-                AvgAvoid = Vector2Subtract(
-                    AvgAvoid,
-                    Vector2Scale(
-                        Vector2Normalize( Vector2Subtract(
-                            Boid2->getPosition(), Boid1->getPosition() ) ),
-                        10.f / Clamp( Distance, 0.001f, 100.f ) ) );
-            }
+    // Only the active index is kept up to date
+    QInstance->clear();
+    Grid->clear();
+    VerletValid = false;
+}
+
+void BoidManager::setLocalSize( const float LocalSize_ ) {
+    LocalSize = std::max( LocalSize_, 1.f );
+    VerletValid = false;
+}
+
+void BoidManager::setTopological( const bool Enabled,
+                                  const size_t Neighbours ) {
+    Topological = Enabled;
+    TopologicalCount = std::max< size_t >( Neighbours, 1 );
+}
+
+void BoidManager::setVerletLists( const bool Enabled, const float Skin ) {
+    VerletLists = Enabled;
+    VerletSkin = std::max( Skin, 0.f );
+    VerletValid = false;
+}
+
+bool BoidManager::useVerletLists() const {
+    return VerletLists &&
+           !( ( ApproximateTree || Topological ) && Backend == B_Quadtree );
+}
+
+bool BoidManager::verletListsValid() const {
+    if ( !VerletValid || VerletAnchorX.size() != Store.size() ) return false;
+
+    const float Limit = VerletSkin * VerletSkin * 0.25f;
+
+    for ( size_t i = 0; i < Store.size(); ++i ) {
+        const float Dx = Store.PositionX[i] - VerletAnchorX[i];
+        const float Dy = Store.PositionY[i] - VerletAnchorY[i];
+
+        if ( Dx * Dx + Dy * Dy > Limit ) return false;
+    }
+
+    return true;
+}
+
+void BoidManager::prepareNeighbours( const bool Threaded ) {
+    if ( !useVerletLists() ) {
+        buildSpatialIndex();
+        return;
+    }
+
+    if ( verletListsValid() ) return;
+
+    buildSpatialIndex();
+
+    BOIDS_ZONE( "Verlet lists" );
+
+    const size_t Count = Store.size();
+    VerletOffsets.resize( Count + 1 );
+
+    if ( Threaded ) {
+        runPhase( S_BuildVerlet );
+        finishVerletLists( ActiveThreads );
+    } else {
+        buildVerletRange( 0, 0, Count );
+        finishVerletLists( 1 );
+    }
+
+    VerletAnchorX = Store.PositionX;
+    VerletAnchorY = Store.PositionY;
+
+    VerletValid = true;
+    VerletBuilds += 1;
+}
+
+void BoidManager::buildVerletRange( const size_t Chunk, const size_t Begin,
+                                    const size_t End ) {
+    std::vector< size_t >& Neighbours = VerletChunks[Chunk];
+    Neighbours.clear();
+
+    BumpArena& Arena = Arenas[Chunk];
+    const float Radius = LocalSize + VerletSkin;
+
+    for ( size_t i = Begin; i < End; ++i ) {
+        BumpArena::Scope Scope( Arena );
+        const Vector2 Position = Store.getPosition( i );
+
+        const auto Targets =
+            ( Backend == B_CellGrid )
+                ? Grid->query( Position, Radius, Arena )
+                : QInstance->query( Store, Position, Radius, Arena );
+
+        // Counts for now, finishVerletLists turns them into offsets
+        VerletOffsets[i + 1] = Targets.size();
+        Neighbours.insert( Neighbours.end(), Targets.begin(), Targets.end() );
+    }
+}
 
-            AvgVelocity = Vector2Scale( AvgVelocity, 1.f / ( Count * 8.f ) );
+void BoidManager::finishVerletLists( const size_t Chunks ) {
+    const size_t Count = Store.size();
 
-            AvgPosition = Vector2Scale( AvgPosition, 1.f / Count );
-            AvgPosition = Vector2Subtract( AvgPosition, Boid1->getPosition() );
-            AvgPosition = Vector2Scale( AvgPosition, 1.f / 100.f );
+    VerletOffsets[0] = 0;
+    for ( size_t i = 0; i < Count; ++i ) {
+        VerletOffsets[i + 1] += VerletOffsets[i];
+    }
 
-            AvgVelocity = Vector2Scale( AvgVelocity, SimScale );
-            AvgPosition = Vector2Scale( AvgPosition, SimScale );
-            AvgAvoid = Vector2Scale( AvgAvoid, SimScale );
+    VerletNeighbours.resize( VerletOffsets[Count] );
 
-            Boid1->setVelocity( Vector2Add(
-                Boid1->getVelocity(),
-                Vector2Add(
-                    AvgVelocity,
-                    Vector2Add( AvgPosition,
-                                Vector2Add( AvgAvoid, Boid1->boundPosition(
-                                                          Bounds ) ) ) ) ) );
+    // Chunks hold consecutive boids, so each lands where its first boid's
+    // list starts
+    const size_t Stride = Count / Chunks;
+    for ( size_t c = 0; c < Chunks; ++c ) {
+        std::copy( VerletChunks[c].begin(), VerletChunks[c].end(),
+                   VerletNeighbours.begin() + VerletOffsets[c * Stride] );
+    }
+}
 
-            if ( Vector2Length( Boid1->getVelocity() ) > SpeedLimit ) {
-                Boid1->setVelocity( Vector2Scale(
-                    Vector2Normalize( Boid1->getVelocity() ), SpeedLimit ) );
+void BoidManager::updateTreeThread() {
+    BOIDS_ZONE( "updateTreeThread" );
+    beginTick();
+
+    measure( Stats.IndexMs, [this]() { prepareNeighbours( true ); } );
+
+    if ( DoubleBuffered ) {
+        measure( Stats.VelocityMs, [this]() {
+            Next.resize( Store.size() );
+            runPhase( S_TreeFused );
+            Store.swapState( Next );
+        } );
+    } else {
+        measure( Stats.VelocityMs, [this]() { runPhase( S_TreeVelocity ); } );
+        measure( Stats.PositionMs, [this]() { runPhase( S_Position ); } );
+    }
+
+    endTick();
+}
+
+void BoidManager::updateTree() {
+    BOIDS_ZONE( "updateTree" );
+    beginTick();
+
+    measure( Stats.IndexMs, [this]() { prepareNeighbours( false ); } );
+
+    if ( DoubleBuffered ) {
+        measure( Stats.VelocityMs, [this]() {
+            BOIDS_ZONE( "Fused" );
+            Next.resize( Store.size() );
+
+            for ( size_t i = 0; i < Store.size(); ++i ) {
+                const BoidsUpdateValues Values =
+                    gatherTreeNeighbours( i, Arenas[0] );
+                NeighbourCosts[i] = static_cast< unsigned >( Values.Count ) + 1;
+                advance( i, Values );
             }
-        }
-    } else if ( UStatus == S_Position ) {
-        for ( size_t i = Start; i < End; ++i ) {
-            auto& Boid1 = BoidList[i];
 
-            Boid1->setPosition(
-                Vector2Add( Boid1->getPosition(), Boid1->getVelocity() ) );
-        }
+            Store.swapState( Next );
+        } );
+    } else {
+        measure( Stats.VelocityMs, [this]() {
+            BOIDS_ZONE( "Velocity" );
+            for ( size_t i = 0; i < Store.size(); ++i ) {
+                BoidsUpdateValues Values = gatherTreeNeighbours( i, Arenas[0] );
+                NeighbourCosts[i] = static_cast< unsigned >( Values.Count ) + 1;
+                steer( i, Values );
+            }
+        } );
+
+        measure( Stats.PositionMs, [this]() { integrate(); } );
     }
+
+    endTick();
+}
+
+void BoidManager::updateThread() {
+    BOIDS_ZONE( "updateThread" );
+    beginTick();
+
+    if ( DoubleBuffered ) {
+        measure( Stats.VelocityMs, [this]() {
+            Next.resize( Store.size() );
+            runPhase( S_Fused );
+            Store.swapState( Next );
+        } );
+    } else {
+        measure( Stats.VelocityMs, [this]() { runPhase( S_Velocity ); } );
+        measure( Stats.PositionMs, [this]() { runPhase( S_Position ); } );
+    }
+
+    endTick();
+}
+
+void BoidManager::runPhase( const UpdateStatus Phase ) {
+    const size_t Count = Store.size();
+
+    const bool Brute = Phase == S_Velocity || Phase == S_Fused;
+    const bool Tree = Phase == S_TreeVelocity || Phase == S_TreeFused;
+
+    // Brute force costs the same for every boid
+    if ( WorkStealing && Brute ) Scheduler.prepare( Count, ActiveThreads, {} );
+    if ( WorkStealing && Tree )
+        Scheduler.prepare( Count, ActiveThreads, NeighbourCosts );
+
+    UStatus = Phase;
+
+    const auto Start = std::chrono::steady_clock::now();
+    Stp->runTask();
+    const auto End = std::chrono::steady_clock::now();
+
+    PhaseSeconds += std::chrono::duration< double >( End - Start ).count();
+
+    if ( WorkStealing && ( Brute || Tree ) )
+        Steals += Scheduler.getStealCount();
 }
 
 void BoidManager::updateThreadWorker( const size_t ThreadId ) {
-    const size_t Stride = MAX / ThreadCount;
+    // Workers past the active count sit the task out
+    if ( ThreadId >= ActiveThreads ) return;
 
-    const size_t Start = ThreadId * Stride;
+    // Indexed by UpdateStatus
+    [[maybe_unused]] static constexpr const char* PhaseNames[] = {
+        "Velocity",   "Tree velocity", "Position",   "Fused",
+        "Tree fused", "Verlet lists",  "Tree build", "Tree stitch" };
 
-    size_t End = ( ThreadId + 1 ) * Stride;
-    if ( ThreadId == ThreadCount - 1 ) End = MAX;
+    BOIDS_ZONE_THREAD( fmt::format( "Pool worker {}", ThreadId ) );
+    BOIDS_ZONE( PhaseNames[UStatus] );
+
+    const auto Start = std::chrono::steady_clock::now();
 
     if ( UStatus == S_Velocity ) {
-        for ( size_t i = Start; i < End; ++i ) {
-            auto& Boid1 = BoidList[i];
-
-            Vector2 AvgPosition( 0.f ); // Cohesion
-            Vector2 AvgVelocity( 0.f ); // Alignment
-            Vector2 AvgAvoid( 0.f );    // Seperation
-            size_t Count = 0;
-
-            for ( auto& Boid2 : BoidList ) {
-                const float Distance = Vector2Distance( Boid1->getPosition(),
-                                                        Boid2->getPosition() );
-                if ( Distance >= LocalSize ) continue;
-
-                Count += 1;
-                // Alignment
-                AvgVelocity = Vector2Add( AvgVelocity, Boid2->getVelocity() );
-                // Cohesion
-                AvgPosition = Vector2Add( AvgPosition, Boid2->getPosition() );
-                // Separation
-                if ( Distance >= LocalSize * 0.4f ) continue;
-                AvgAvoid = Vector2Subtract(
-                    AvgAvoid,
-                    Vector2Scale(
-                        Vector2Normalize( Vector2Subtract(
-                            Boid2->getPosition(), Boid1->getPosition() ) ),
-                        10.f / Clamp( Distance, 0.001f, 100.f ) ) );
+        forEachRange( ThreadId, [this]( const size_t Begin, const size_t End ) {
+            for ( size_t i = Begin; i < End; ++i ) {
+                BoidsUpdateValues Values = gatherNeighbours( i );
+                NeighbourCosts[i] = static_cast< unsigned >( Values.Count ) + 1;
+                steer( i, Values );
+            }
+        } );
+    } else if ( UStatus == S_TreeVelocity ) {
+        BumpArena& Arena = Arenas[ThreadId];
+        forEachRange( ThreadId, [this, &Arena]( const size_t Begin,
+                                                const size_t End ) {
+            for ( size_t i = Begin; i < End; ++i ) {
+                BoidsUpdateValues Values = gatherTreeNeighbours( i, Arena );
+                // Next tick's cost estimate for the scheduler
+                NeighbourCosts[i] = static_cast< unsigned >( Values.Count ) + 1;
+                steer( i, Values );
             }
+        } );
+    } else if ( UStatus == S_Fused ) {
+        forEachRange( ThreadId, [this]( const size_t Begin, const size_t End ) {
+            for ( size_t i = Begin; i < End; ++i ) {
+                const BoidsUpdateValues Values = gatherNeighbours( i );
+                NeighbourCosts[i] = static_cast< unsigned >( Values.Count ) + 1;
+                advance( i, Values );
+            }
+        } );
+    } else if ( UStatus == S_TreeFused ) {
+        BumpArena& Arena = Arenas[ThreadId];
+        forEachRange( ThreadId, [this, &Arena]( const size_t Begin,
+                                                const size_t End ) {
+            for ( size_t i = Begin; i < End; ++i ) {
+                const BoidsUpdateValues Values =
+                    gatherTreeNeighbours( i, Arena );
+                NeighbourCosts[i] = static_cast< unsigned >( Values.Count ) + 1;
+                advance( i, Values );
+            }
+        } );
+    } else if ( UStatus == S_Position ) {
+        const size_t Count = Store.size();
+        const size_t Stride = Count / ActiveThreads;
 
-            AvgVelocity = Vector2Scale( AvgVelocity, 1.f / ( Count * 8.f ) );
+        const size_t Begin = ThreadId * Stride;
 
-            AvgPosition = Vector2Scale( AvgPosition, 1.f / Count );
-            AvgPosition = Vector2Subtract( AvgPosition, Boid1->getPosition() );
-            AvgPosition = Vector2Scale( AvgPosition, 1.f / 100.f );
+        size_t End = ( ThreadId + 1 ) * Stride;
+        if ( ThreadId == ActiveThreads - 1 ) End = Count;
 
-            AvgVelocity = Vector2Scale( AvgVelocity, SimScale );
-            AvgPosition = Vector2Scale( AvgPosition, SimScale );
-            AvgAvoid = Vector2Scale( AvgAvoid, SimScale );
+        for ( size_t i = Begin; i < End; ++i ) {
+            Store.PositionX[i] += Store.VelocityX[i];
+            Store.PositionY[i] += Store.VelocityY[i];
+        }
+    } else if ( UStatus == S_BuildVerlet ) {
+        const size_t Count = Store.size();
+        const size_t Stride = Count / ActiveThreads;
+
+        size_t End = ( ThreadId + 1 ) * Stride;
+        if ( ThreadId == ActiveThreads - 1 ) End = Count;
+
+        buildVerletRange( ThreadId, ThreadId * Stride, End );
+    } else if ( UStatus == S_BuildTree ) {
+        QInstance->buildTasks( ThreadId, ActiveThreads );
+    } else if ( UStatus == S_StitchTree ) {
+        QInstance->stitchTasks( ThreadId, ActiveThreads );
+    }
 
-            Boid1->setVelocity( Vector2Add(
-                Boid1->getVelocity(),
-                Vector2Add(
-                    AvgVelocity,
-                    Vector2Add( AvgPosition,
-                                Vector2Add( AvgAvoid, Boid1->boundPosition(
-                                                          Bounds ) ) ) ) ) );
+    const auto End = std::chrono::steady_clock::now();
+    ThreadLoads[ThreadId].Busy +=
+        std::chrono::duration< double >( End - Start ).count();
+}
 
-            if ( Vector2Length( Boid1->getVelocity() ) > SpeedLimit ) {
-                Boid1->setVelocity( Vector2Scale(
-                    Vector2Normalize( Boid1->getVelocity() ), SpeedLimit ) );
-            }
-        }
-    } else if ( UStatus == S_Position ) {
-        for ( size_t i = Start; i < End; ++i ) {
-            auto& Boid1 = BoidList[i];
+std::vector< float > BoidManager::getThreadUtilisation() const {
+    std::vector< float > Result( ActiveThreads, 0.f );
+    if ( PhaseSeconds <= 0.0 ) return Result;
 
-            Boid1->setPosition(
-                Vector2Add( Boid1->getPosition(), Boid1->getVelocity() ) );
+    for ( size_t t = 0; t < ActiveThreads; ++t ) {
+        Result[t] = static_cast< float >( ThreadLoads[t].Busy / PhaseSeconds );
+    }
+
+    return Result;
+}
+
+void BoidManager::reportThreadUtilisation() {
+    const std::vector< float > Utilisation = getThreadUtilisation();
+
+    if ( !Utilisation.empty() && PhaseSeconds > 0.0 ) {
+        const auto [Min, Max] =
+            std::minmax_element( Utilisation.begin(), Utilisation.end() );
+        const float Mean =
+            std::accumulate( Utilisation.begin(), Utilisation.end(), 0.f ) /
+            Utilisation.size();
+
+        Trace::message( fmt::format(
+            "{:>24}: {}, busy mean {:.1f}%, min {:.1f}%, max {:.1f}% over "
+            "{:.2f} ms, {} steals",
+            "Thread utilisation", WorkStealing ? "work stealing" : "static",
+            Mean * 100.f, *Min * 100.f, *Max * 100.f, PhaseSeconds * 1000.0,
+            Steals ) );
+
+        std::string PerThread;
+        for ( const float Busy : Utilisation ) {
+            PerThread += fmt::format( " {:.0f}", Busy * 100.f );
         }
+
+        Trace::message( fmt::format( "{:>24}:{}", "Busy % per thread",
+                                     PerThread ) );
+    }
+
+    resetThreadUtilisation();
+}
+
+void BoidManager::resetThreadUtilisation() {
+    for ( auto& Load : ThreadLoads ) {
+        Load.Busy = 0.0;
     }
+
+    PhaseSeconds = 0.0;
+    Steals = 0;
 }
 
 void BoidManager::update() {
-    for ( auto& Boid1 : BoidList ) {
-        Vector2 AvgPosition( 0.f ); // Cohesion
-        Vector2 AvgVelocity( 0.f ); // Alignment
-        Vector2 AvgAvoid( 0.f );    // Seperation
-        size_t Count = 0;
-
-        for ( auto& Boid2 : BoidList ) {
-            const float Distance =
-                Vector2Distance( Boid1->getPosition(), Boid2->getPosition() );
-            if ( Distance >= LocalSize ) continue;
+    BOIDS_ZONE( "update" );
+    beginTick();
+
+    if ( DoubleBuffered ) {
+        measure( Stats.VelocityMs, [this]() {
+            BOIDS_ZONE( "Fused" );
+            Next.resize( Store.size() );
+
+            for ( size_t i = 0; i < Store.size(); ++i ) {
+                const BoidsUpdateValues Values = gatherNeighbours( i );
+                NeighbourCosts[i] = static_cast< unsigned >( Values.Count ) + 1;
+                advance( i, Values );
+            }
 
-            Count += 1;
-            // Alignment
-            AvgVelocity = Vector2Add( AvgVelocity, Boid2->getVelocity() );
-            // Cohesion
-            AvgPosition = Vector2Add( AvgPosition, Boid2->getPosition() );
-            // Separation
-            if ( Distance >= LocalSize * 0.4f ) continue;
-            AvgAvoid = Vector2Subtract(
-                AvgAvoid,
-                Vector2Scale(
-                    Vector2Normalize( Vector2Subtract( Boid2->getPosition(),
-                                                       Boid1->getPosition() ) ),
-                    10.f / Clamp( Distance, 0.001f, 100.f ) ) );
-        }
+            Store.swapState( Next );
+        } );
+    } else {
+        measure( Stats.VelocityMs, [this]() {
+            BOIDS_ZONE( "Velocity" );
+            for ( size_t i = 0; i < Store.size(); ++i ) {
+                BoidsUpdateValues Values = gatherNeighbours( i );
+                NeighbourCosts[i] = static_cast< unsigned >( Values.Count ) + 1;
+                steer( i, Values );
+            }
+        } );
+
+        measure( Stats.PositionMs, [this]() { integrate(); } );
+    }
+
+    endTick();
+}
+
+void BoidManager::integrate() {
+    BOIDS_ZONE( "Position" );
+    for ( size_t i = 0; i < Store.size(); ++i ) {
+        Store.PositionX[i] += Store.VelocityX[i];
+        Store.PositionY[i] += Store.VelocityY[i];
+    }
+}
+
+BoidsUpdateValues BoidManager::gatherNeighbours( const size_t Index ) const {
+    BoidsUpdateValues Values;
+
+    NeighbourKernel::accumulate( Store, 0, Store.size(),
+                                 Store.getPosition( Index ), LocalSize,
+                                 LocalSize * 0.4f, Values );
+
+    return Values;
+}
+
+BoidsUpdateValues
+BoidManager::gatherTreeNeighbours( const size_t Index,
+                                   BumpArena& Arena ) const {
+    if ( Topological && Backend == B_Quadtree )
+        return nearestNeighbours( Index, Arena );
+
+    if ( ApproximateTree && Backend == B_Quadtree )
+        return QInstance->calculateVelocity( Store, Index, LocalSize );
+
+    if ( VerletLists ) return listNeighbours( Index );
+
+    return queryNeighbours( Index, Arena );
+}
+
+BoidsUpdateValues BoidManager::listNeighbours( const size_t Index ) const {
+    BoidsUpdateValues Values;
+
+    const size_t Begin = VerletOffsets[Index];
+
+    NeighbourKernel::accumulate( Store, VerletNeighbours.data() + Begin,
+                                 VerletOffsets[Index + 1] - Begin, Index,
+                                 Store.getPosition( Index ), LocalSize,
+                                 LocalSize * 0.4f, Values );
+
+    return Values;
+}
+
+BoidsUpdateValues BoidManager::queryNeighbours( const size_t Index,
+                                                BumpArena& Arena ) const {
+    BoidsUpdateValues Values;
+
+    BumpArena::Scope Scope( Arena );
+    const Vector2 Position = Store.getPosition( Index );
+
+    const auto Targets =
+        ( Backend == B_CellGrid )
+            ? Grid->query( Position, LocalSize, Arena )
+            : QInstance->query( Store, Position, LocalSize, Arena );
+
+    NeighbourKernel::accumulate( Store, Targets.data(), Targets.size(), Index,
+                                 Position, LocalSize, LocalSize * 0.4f,
+                                 Values );
+
+    return Values;
+}
+
+BoidsUpdateValues BoidManager::nearestNeighbours( const size_t Index,
+                                                  BumpArena& Arena ) const {
+    BoidsUpdateValues Values;
+
+    BumpArena::Scope Scope( Arena );
+    const Vector2 Position = Store.getPosition( Index );
+
+    const auto Targets = QInstance->findNearest( Store, Position,
+                                                 TopologicalCount, Index,
+                                                 Arena );
+
+    // No radius, the neighbour count alone decides who takes part
+    NeighbourKernel::accumulate( Store, Targets.data(), Targets.size(), Index,
+                                 Position,
+                                 std::numeric_limits< float >::infinity(),
+                                 LocalSize * 0.4f, Values );
+
+    return Values;
+}
+
+void BoidManager::steer( const size_t Index, BoidsUpdateValues& Values ) {
+    Store.setVelocity( Index, steeredVelocity( Index, Values ) );
+}
+
+void BoidManager::advance( const size_t Index,
+                           const BoidsUpdateValues& Values ) {
+    const Vector2 Velocity = steeredVelocity( Index, Values );
+
+    Next.setVelocity( Index, Velocity );
+    Next.setPosition( Index,
+                      Vector2Add( Store.getPosition( Index ), Velocity ) );
+}
+
+Vector2 BoidManager::steeredVelocity( const size_t Index,
+                                      BoidsUpdateValues Values ) const {
+    const Vector2 Position = Store.getPosition( Index );
+
+    if ( Values.Count > 0 ) {
+        Values.AvgVelocity =
+            Vector2Scale( Values.AvgVelocity, 1.f / ( Values.Count * 8.f ) );
+
+        Values.AvgPosition =
+            Vector2Scale( Values.AvgPosition, 1.f / Values.Count );
+        Values.AvgPosition = Vector2Subtract( Values.AvgPosition, Position );
+        Values.AvgPosition = Vector2Scale( Values.AvgPosition, 1.f / 100.f );
+
+        Values.AvgVelocity = Vector2Scale( Values.AvgVelocity, SimScale );
+        Values.AvgPosition = Vector2Scale( Values.AvgPosition, SimScale );
+        Values.AvgAvoid = Vector2Scale( Values.AvgAvoid, SimScale );
+    }
+
+    Vector2 Velocity = Vector2Add(
+        Store.getVelocity( Index ),
+        Vector2Add( Values.AvgVelocity,
+                    Vector2Add( Values.AvgPosition,
+                                Vector2Add( Values.AvgAvoid,
+                                            Prototype->boundPosition(
+                                                Position, Bounds ) ) ) ) );
 
-        AvgVelocity = Vector2Scale( AvgVelocity, 1.f / Count );
-        AvgVelocity = Vector2Scale( AvgVelocity, 1.f / 8.f );
+    if ( Vector2Length( Velocity ) > SpeedLimit ) {
+        Velocity = Vector2Scale( Vector2Normalize( Velocity ), SpeedLimit );
+    }
+
+    return Velocity;
+}
+
+float BoidManager::measureApproximationError() {
+    const size_t Count = Store.size();
+    if ( Count == 0 || Backend != B_Quadtree ) return 0.f;
+
+    // A tree of its own, so the simulation's tree and its incremental
+    // rebuild schedule are left as they were
+    Quadtree Tree;
+    Tree.setTheta( QInstance->getTheta() );
+    Tree.build( Store );
+    Tree.computeAggregates( Store );
 
-        AvgPosition = Vector2Scale( AvgPosition, 1.f / Count );
-        AvgPosition = Vector2Subtract( AvgPosition, Boid1->getPosition() );
-        AvgPosition = Vector2Scale( AvgPosition, 1.f / 100.f );
+    const size_t SampleCount = std::min< size_t >( Count, 1024 );
+    const size_t Step = Count / SampleCount;
 
-        Boid1->setVelocity( Vector2Add(
-            Boid1->getVelocity(),
-            Vector2Add(
-                AvgVelocity,
-                Vector2Add( AvgPosition,
-                            Vector2Add( AvgAvoid, Boid1->boundPosition(
-                                                      Bounds ) ) ) ) ) );
+    float Total = 0.f;
+    float Worst = 0.f;
 
-        if ( Vector2Length( Boid1->getVelocity() ) > SpeedLimit ) {
-            Boid1->setVelocity( Vector2Scale(
-                Vector2Normalize( Boid1->getVelocity() ), SpeedLimit ) );
+    for ( size_t s = 0; s < SampleCount; ++s ) {
+        const size_t i = s * Step;
+        const Vector2 Position = Store.getPosition( i );
+
+        BoidsUpdateValues Values;
+        {
+            BumpArena::Scope Scope( Arenas[0] );
+            const auto Targets =
+                Tree.query( Store, Position, LocalSize, Arenas[0] );
+
+            NeighbourKernel::accumulate( Store, Targets.data(),
+                                         Targets.size(), i, Position,
+                                         LocalSize, LocalSize * 0.4f, Values );
         }
+
+        const Vector2 Exact = steeredVelocity( i, Values );
+        const Vector2 Approximate = steeredVelocity(
+            i, Tree.calculateVelocity( Store, i, LocalSize ) );
+
+        const float Error =
+            Vector2Distance( Exact, Approximate ) / SpeedLimit;
+
+        Total += Error;
+        Worst = std::max( Worst, Error );
     }
 
-    for ( auto& Boid1 : BoidList ) {
-        Boid1->setPosition(
-            Vector2Add( Boid1->getPosition(), Boid1->getVelocity() ) );
+    const float Mean = Total / SampleCount;
+
+    Trace::message( fmt::format(
+        "{:>24}: theta {:.2f}, mean {:.4f}, max {:.4f} of SpeedLimit",
+        "Barnes-Hut error", Tree.getTheta(), Mean, Worst ) );
+
+    return Mean;
+}
+
+float BoidManager::measureKernelError() const {
+    const size_t Count = Store.size();
+    if ( Count == 0 ) return 0.f;
+
+    const size_t SampleCount = std::min< size_t >( Count, 1024 );
+    const size_t Step = Count / SampleCount;
+
+    float Total = 0.f;
+    float Worst = 0.f;
+
+    for ( size_t s = 0; s < SampleCount; ++s ) {
+        const size_t i = s * Step;
+        const Vector2 Position = Store.getPosition( i );
+
+        // Reference path through BoidsUpdateValues::add
+        BoidsUpdateValues Reference;
+        for ( size_t j = 0; j < Count; ++j ) {
+            const Vector2 OtherPosition = Store.getPosition( j );
+
+            const float Distance = Vector2Distance( Position, OtherPosition );
+            if ( Distance >= LocalSize ) continue;
+
+            Reference.add( Position, OtherPosition, Store.getVelocity( j ),
+                           Distance, LocalSize * 0.4f );
+        }
+
+        const Vector2 Exact = steeredVelocity( i, Reference );
+        const Vector2 Vectorised = steeredVelocity( i, gatherNeighbours( i ) );
+
+        const float Error = Vector2Distance( Exact, Vectorised ) / SpeedLimit;
+
+        Total += Error;
+        Worst = std::max( Worst, Error );
     }
+
+    const float Mean = Total / SampleCount;
+
+    Trace::message( fmt::format(
+        "{:>24}: {}, mean {:.6f}, max {:.6f} of SpeedLimit",
+        "Neighbour kernel error",
+        NeighbourKernel::getIsaName( NeighbourKernel::getIsa() ), Mean,
+        Worst ) );
+
+    return Worst;
 }
 
-void BoidManager::draw() const {
-    for ( auto& BoidInstance : BoidList ) {
-        BoidInstance->draw();
+void BoidManager::draw() const { draw( *Prototype, Store, 1.f ); }
+
+void BoidManager::draw( const Boid& Prototype, const BoidStore& Snapshot,
+                        const float Interpolation ) {
+    BOIDS_ZONE( "Draw boids" );
+
+    const float Back = 1.f - Interpolation;
+
+    for ( size_t i = 0; i < Snapshot.size(); ++i ) {
+        const Vector2 Velocity = Snapshot.getVelocity( i );
+
+        Prototype.draw( Vector2Subtract( Snapshot.getPosition( i ),
+                                         Vector2Scale( Velocity, Back ) ),
+                        Velocity );
     }
 }
 
+Boid BoidManager::makePrototype() {
+    return Boid( DefaultLocalSize / 13.f, DefaultSimScale );
+}
+
 Vector2 BoidManager::accumulatePosition() const {
     Vector2 Result( 0.f );
-    for ( auto& BoidInstance : BoidList ) {
-        Result = Vector2Add( Result, BoidInstance->getPosition() );
+    for ( size_t i = 0; i < Store.size(); ++i ) {
+        Result = Vector2Add( Result, Store.getPosition( i ) );
     }
 
     return Result;
@@ -356,8 +1212,8 @@ Vector2 BoidManager::accumulatePosition() const {
 
 Vector2 BoidManager::accumulateVelocity() const {
     Vector2 Result( 0.f );
-    for ( auto& BoidInstance : BoidList ) {
-        Result = Vector2Add( Result, BoidInstance->getVelocity() );
+    for ( size_t i = 0; i < Store.size(); ++i ) {
+        Result = Vector2Add( Result, Store.getVelocity( i ) );
     }
 
     return Result;
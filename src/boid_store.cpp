@@ -0,0 +1,80 @@
+
+#include "boid_store.hpp"
+
+template < typename T >
+static void gather( AlignedVector< T >& Values,
+                    const std::vector< unsigned >& Order,
+                    AlignedVector< T >& Result ) {
+    Result.resize( Values.size() );
+
+    for ( size_t i = 0; i < Order.size(); ++i ) {
+        Result[i] = Values[Order[i]];
+    }
+
+    Values.swap( Result );
+}
+
+void BoidStore::resize( const size_t Count ) {
+    PositionX.resize( Count, 0.f );
+    PositionY.resize( Count, 0.f );
+    VelocityX.resize( Count, 0.f );
+    VelocityY.resize( Count, 0.f );
+
+    Ids.resize( Count, 0 );
+}
+
+void BoidStore::reserve( const size_t Count ) {
+    PositionX.reserve( Count );
+    PositionY.reserve( Count );
+    VelocityX.reserve( Count );
+    VelocityY.reserve( Count );
+
+    Ids.reserve( Count );
+}
+
+void BoidStore::push( const Vector2& Position, const Vector2& Velocity,
+                      const size_t Id ) {
+    PositionX.push_back( Position.x );
+    PositionY.push_back( Position.y );
+    VelocityX.push_back( Velocity.x );
+    VelocityY.push_back( Velocity.y );
+
+    Ids.push_back( Id );
+}
+
+void BoidStore::swapRemove( const size_t Index ) {
+    const size_t Last = size() - 1;
+
+    if ( Index != Last ) {
+        PositionX[Index] = PositionX[Last];
+        PositionY[Index] = PositionY[Last];
+        VelocityX[Index] = VelocityX[Last];
+        VelocityY[Index] = VelocityY[Last];
+
+        Ids[Index] = Ids[Last];
+    }
+
+    PositionX.pop_back();
+    PositionY.pop_back();
+    VelocityX.pop_back();
+    VelocityY.pop_back();
+
+    Ids.pop_back();
+}
+
+void BoidStore::reorder( const std::vector< unsigned >& Order,
+                         BoidStore& Scratch ) {
+    gather( PositionX, Order, Scratch.PositionX );
+    gather( PositionY, Order, Scratch.PositionY );
+    gather( VelocityX, Order, Scratch.VelocityX );
+    gather( VelocityY, Order, Scratch.VelocityY );
+
+    gather( Ids, Order, Scratch.Ids );
+}
+
+void BoidStore::swapState( BoidStore& Other ) {
+    PositionX.swap( Other.PositionX );
+    PositionY.swap( Other.PositionY );
+    VelocityX.swap( Other.VelocityX );
+    VelocityY.swap( Other.VelocityY );
+}
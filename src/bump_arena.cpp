@@ -0,0 +1,97 @@
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "bump_arena.hpp"
+
+namespace {
+
+size_t alignUp( const size_t Offset, const size_t Alignment ) {
+    return ( Offset + Alignment - 1 ) & ~( Alignment - 1 );
+}
+
+} // namespace
+
+BumpArena::BumpArena( const size_t BlockSize_ ) : BlockSize( BlockSize_ ) {}
+
+void* BumpArena::allocate( const size_t Bytes, const size_t Alignment ) {
+    // Blocks come from operator new[], aligned for any fundamental type
+    assert( Alignment <= alignof( std::max_align_t ) );
+
+    size_t Start = alignUp( Top, Alignment );
+
+    if ( Blocks.empty() || Start + Bytes > Blocks[Current].Size ) {
+        nextBlock( Bytes );
+        Start = 0;
+    }
+
+    LastStart = Start;
+    Top = Start + Bytes;
+    HighWater = std::max( HighWater, getUsed() );
+
+    return Blocks[Current].Data.get() + Start;
+}
+
+void* BumpArena::grow( void* Last, const size_t Used, const size_t Bytes,
+                       const size_t Alignment ) {
+    const Block& Latest = Blocks[Current];
+
+    if ( static_cast< std::byte* >( Last ) == Latest.Data.get() + LastStart &&
+         LastStart + Bytes <= Latest.Size ) {
+        Top = LastStart + Bytes;
+        HighWater = std::max( HighWater, getUsed() );
+        return Last;
+    }
+
+    void* Moved = allocate( Bytes, Alignment );
+    std::memcpy( Moved, Last, Used );
+
+    return Moved;
+}
+
+void BumpArena::rewind( const Marker& Mark ) {
+    Current = Mark.Block;
+    Top = Mark.Top;
+    Passed = Mark.Passed;
+    LastStart = Top;
+}
+
+void BumpArena::reset() {
+    if ( Blocks.size() > 1 ) {
+        const size_t Size = getCapacity();
+
+        Blocks.clear();
+        Blocks.push_back( Block{ std::unique_ptr< std::byte[] >(
+                                     new std::byte[Size] ),
+                                 Size } );
+    }
+
+    rewind( Marker{} );
+}
+
+size_t BumpArena::getCapacity() const {
+    size_t Capacity = 0;
+    for ( const Block& Each : Blocks ) {
+        Capacity += Each.Size;
+    }
+
+    return Capacity;
+}
+
+void BumpArena::nextBlock( const size_t Bytes ) {
+    if ( !Blocks.empty() ) {
+        Passed += Top;
+        Current += 1;
+    }
+
+    Top = 0;
+
+    if ( Current < Blocks.size() && Blocks[Current].Size >= Bytes ) return;
+
+    // Left uninitialised, unlike make_unique
+    const size_t Size = std::max( BlockSize, Bytes );
+    Blocks.insert( Blocks.begin() + static_cast< std::ptrdiff_t >( Current ),
+                   Block{ std::unique_ptr< std::byte[] >( new std::byte[Size] ),
+                          Size } );
+}
@@ -0,0 +1,99 @@
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "cell_grid.hpp"
+
+void CellGrid::build( const BoidStore& Store, const float CellSize_ ) {
+    Source = &Store;
+
+    const size_t Count = Store.size();
+
+    Vector2 Min = Vector2{ std::numeric_limits< float >::max(),
+                           std::numeric_limits< float >::max() };
+    Vector2 Max = Vector2{ std::numeric_limits< float >::lowest(),
+                           std::numeric_limits< float >::lowest() };
+
+    for ( size_t i = 0; i < Count; ++i ) {
+        Min.x = std::min( Min.x, Store.PositionX[i] );
+        Min.y = std::min( Min.y, Store.PositionY[i] );
+        Max.x = std::max( Max.x, Store.PositionX[i] );
+        Max.y = std::max( Max.y, Store.PositionY[i] );
+    }
+
+    if ( Count == 0 ) Min = Max = Vector2{ 0.f, 0.f };
+
+    const float Extent = std::max( Max.x - Min.x, Max.y - Min.y );
+
+    CellSize = std::max( CellSize_, Extent / MaxCellsPerAxis );
+    InvCellSize = 1.f / CellSize;
+    Origin = Min;
+
+    Columns = static_cast< int >( ( Max.x - Min.x ) * InvCellSize ) + 1;
+    Rows = static_cast< int >( ( Max.y - Min.y ) * InvCellSize ) + 1;
+
+    const size_t CellCount = static_cast< size_t >( Columns ) * Rows;
+
+    // Twice the room once outgrown, a spreading flock adds cells every few
+    // ticks
+    if ( CellStart.capacity() < CellCount + 1 ) {
+        CellStart.reserve( ( CellCount + 1 ) * 2 );
+        Cursor.reserve( CellCount * 2 );
+    }
+
+    // Counting sort by cell
+    CellStart.assign( CellCount + 1, 0 );
+    CellOf.resize( Count );
+    Indices.resize( Count );
+
+    for ( size_t i = 0; i < Count; ++i ) {
+        const unsigned Cell = static_cast< unsigned >(
+            cellY( Store.PositionY[i] ) * Columns +
+            cellX( Store.PositionX[i] ) );
+
+        CellOf[i] = Cell;
+        CellStart[Cell + 1] += 1;
+    }
+
+    for ( size_t c = 0; c < CellCount; ++c ) {
+        CellStart[c + 1] += CellStart[c];
+    }
+
+    Cursor.assign( CellStart.begin(), CellStart.end() - 1 );
+
+    for ( size_t i = 0; i < Count; ++i ) {
+        Indices[Cursor[CellOf[i]]++] = static_cast< unsigned >( i );
+    }
+}
+
+std::span< size_t > CellGrid::query( const Vector2& Pos, const float Radius,
+                                     BumpArena& Arena ) const {
+    ArenaBuffer< size_t > Targets( Arena );
+
+    forEachInRadius( Pos, Radius, [&Targets]( const size_t Target ) {
+        Targets.push_back( Target );
+    } );
+
+    return Targets.span();
+}
+
+void CellGrid::clear() {
+    CellStart.assign( 1, 0 );
+    CellOf.clear();
+    Indices.clear();
+
+    Source = nullptr;
+}
+
+int CellGrid::cellX( const float X ) const {
+    const int Cell = static_cast< int >( std::floor( ( X - Origin.x ) *
+                                                     InvCellSize ) );
+    return std::clamp( Cell, 0, Columns - 1 );
+}
+
+int CellGrid::cellY( const float Y ) const {
+    const int Cell = static_cast< int >( std::floor( ( Y - Origin.y ) *
+                                                     InvCellSize ) );
+    return std::clamp( Cell, 0, Rows - 1 );
+}
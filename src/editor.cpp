@@ -1,6 +1,11 @@
 
 
 // System includes
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
 #include "imgui.h"
 #include "imgui_impl_opengl3.h"
 #include "imgui_impl_win32.h"
@@ -8,6 +13,28 @@
 // Local includes
 #include "editor.hpp"
 
+extern IMGUI_IMPL_API LRESULT ImGui_ImplWin32_WndProcHandler( HWND hWnd,
+                                                              UINT msg,
+                                                              WPARAM wParam,
+                                                              LPARAM lParam );
+
+namespace {
+
+// The window belongs to raylib, ImGui gets its input by sitting in front of
+// raylib's window procedure
+HWND EditorWindow = nullptr;
+WNDPROC PreviousWndProc = nullptr;
+
+LRESULT CALLBACK editorWndProc( HWND Window, UINT Msg, WPARAM WParam,
+                                LPARAM LParam ) {
+    if ( ImGui_ImplWin32_WndProcHandler( Window, Msg, WParam, LParam ) )
+        return true;
+
+    return CallWindowProc( PreviousWndProc, Window, Msg, WParam, LParam );
+}
+
+} // namespace
+
 void Editor::helpMarker( const char* desc ) {
     ImGui::TextDisabled( "(?)" );
     if ( ImGui::IsItemHovered( ImGuiHoveredFlags_DelayShort ) ) {
@@ -29,23 +56,20 @@ bool Editor::initialize( void* Window ) {
     ImGuiIO& Io = ImGui::GetIO();
     Io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
     Io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;
-    Io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;
+    // No multi-viewport platform windows, raylib owns the only GL context
 
     // Setting style for ImGui
     ImGui::StyleColorsDark();
-    if ( ImGui::GetIO().ConfigFlags & ImGuiConfigFlags_ViewportsEnable ) {
-        ImGuiStyle& Style = ImGui::GetStyle();
-        Style.WindowRounding = 4.f;
-        Style.ChildRounding = 4.f;
-        Style.FrameRounding = 4.f;
-        Style.GrabRounding = 4.f;
-        Style.Colors[ImGuiCol_WindowBg].w = 1.f;
-    }
 
     // Setting up ImGui
     ImGui_ImplWin32_InitForOpenGL( Window );
     ImGui_ImplOpenGL3_Init( "#version 330" );
 
+    EditorWindow = static_cast< HWND >( Window );
+    PreviousWndProc = reinterpret_cast< WNDPROC >(
+        SetWindowLongPtr( EditorWindow, GWLP_WNDPROC,
+                          reinterpret_cast< LONG_PTR >( &editorWndProc ) ) );
+
     // Engine::Instance().AddUpdateCallback( std::bind( &Editor::Update, this )
     // ); Graphics::Instance().AddRenderCallback(
     //     std::bind( &Editor::Render, this ) );
@@ -54,6 +78,12 @@ bool Editor::initialize( void* Window ) {
 }
 
 void Editor::shutdown() {
+    if ( PreviousWndProc != nullptr ) {
+        SetWindowLongPtr( EditorWindow, GWLP_WNDPROC,
+                          reinterpret_cast< LONG_PTR >( PreviousWndProc ) );
+        PreviousWndProc = nullptr;
+    }
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplWin32_Shutdown();
     ImGui::DestroyContext();
@@ -78,13 +108,6 @@ void Editor::update() {
 void Editor::render() {
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData( ImGui::GetDrawData() );
-
-    if ( ImGui::GetIO().ConfigFlags & ImGuiConfigFlags_ViewportsEnable ) {
-        // GLFWwindow* backup_current_context = glfwGetCurrentContext();
-        ImGui::UpdatePlatformWindows();
-        ImGui::RenderPlatformWindowsDefault();
-        // glfwMakeContextCurrent( backup_current_context );
-    }
 }
 
 void Editor::displayDockspace() {
@@ -0,0 +1,325 @@
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "flock_renderer.hpp"
+
+#include "raymath.h"
+#include "rlgl.h"
+
+#include <fmt/core.h>
+#include "trace.hpp"
+#include "zone_profiler.hpp"
+
+namespace {
+
+#if defined( __EMSCRIPTEN__ )
+const char* VertexShaderCode = R"(#version 100
+attribute vec2 meshOffset;
+attribute vec4 meshColor;
+attribute float meshRotates;
+attribute float instancePositionX;
+attribute float instancePositionY;
+attribute float instanceVelocityX;
+attribute float instanceVelocityY;
+uniform mat4 mvp;
+uniform float interpolation;
+varying vec4 fragColor;
+void main() {
+    vec2 Velocity = vec2( instanceVelocityX, instanceVelocityY );
+    float Speed = length( Velocity );
+    vec2 Dir = Speed > 0.0 ? Velocity / Speed : vec2( 1.0, 0.0 );
+    vec2 Offset = meshOffset;
+    if ( meshRotates > 0.5 )
+        Offset = vec2( Dir.x * meshOffset.x - Dir.y * meshOffset.y,
+                       Dir.y * meshOffset.x + Dir.x * meshOffset.y );
+    fragColor = meshColor;
+    vec2 Position = vec2( instancePositionX, instancePositionY ) -
+                    Velocity * ( 1.0 - interpolation );
+    gl_Position = mvp * vec4( Position + Offset, 0.0, 1.0 );
+}
+)";
+
+const char* FragmentShaderCode = R"(#version 100
+precision mediump float;
+varying vec4 fragColor;
+void main() { gl_FragColor = fragColor; }
+)";
+#else
+const char* VertexShaderCode = R"(#version 330
+in vec2 meshOffset;
+in vec4 meshColor;
+in float meshRotates;
+in float instancePositionX;
+in float instancePositionY;
+in float instanceVelocityX;
+in float instanceVelocityY;
+uniform mat4 mvp;
+uniform float interpolation;
+out vec4 fragColor;
+void main() {
+    vec2 Velocity = vec2( instanceVelocityX, instanceVelocityY );
+    float Speed = length( Velocity );
+    vec2 Dir = Speed > 0.0 ? Velocity / Speed : vec2( 1.0, 0.0 );
+    vec2 Offset = meshOffset;
+    if ( meshRotates > 0.5 )
+        Offset = vec2( Dir.x * meshOffset.x - Dir.y * meshOffset.y,
+                       Dir.y * meshOffset.x + Dir.x * meshOffset.y );
+    fragColor = meshColor;
+    vec2 Position = vec2( instancePositionX, instancePositionY ) -
+                    Velocity * ( 1.0 - interpolation );
+    gl_Position = mvp * vec4( Position + Offset, 0.0, 1.0 );
+}
+)";
+
+const char* FragmentShaderCode = R"(#version 330
+in vec4 fragColor;
+out vec4 finalColor;
+void main() { finalColor = fragColor; }
+)";
+#endif
+
+const std::array< const char*, 4 > InstanceAttributes = {
+    "instancePositionX", "instancePositionY", "instanceVelocityX",
+    "instanceVelocityY" };
+
+struct MeshVertex {
+    float X;
+    float Y;
+    float R;
+    float G;
+    float B;
+    float A;
+    float Rotates;
+};
+
+void addVertex( std::vector< MeshVertex >& Mesh, const float X, const float Y,
+                const Color Tint, const bool Rotates ) {
+    Mesh.push_back( MeshVertex{ X, Y, Tint.r / 255.f, Tint.g / 255.f,
+                                Tint.b / 255.f, Tint.a / 255.f,
+                                Rotates ? 1.f : 0.f } );
+}
+
+void addRectangle( std::vector< MeshVertex >& Mesh, const float X0,
+                   const float Y0, const float X1, const float Y1,
+                   const Color Tint ) {
+    addVertex( Mesh, X0, Y0, Tint, false );
+    addVertex( Mesh, X0, Y1, Tint, false );
+    addVertex( Mesh, X1, Y1, Tint, false );
+
+    addVertex( Mesh, X0, Y0, Tint, false );
+    addVertex( Mesh, X1, Y1, Tint, false );
+    addVertex( Mesh, X1, Y0, Tint, false );
+}
+
+// Same shape as Boid::draw, the outline stays axis aligned
+std::vector< MeshVertex > buildMesh( const Boid& Prototype ) {
+    std::vector< MeshVertex > Mesh;
+
+    const float SimScale = Prototype.getSimScale();
+    const float Size = SimScale * Prototype.getScale();
+
+    addVertex( Mesh, Size * 2.f, 0.f, GREEN, true );
+    addVertex( Mesh, -Size, -Size, GREEN, true );
+    addVertex( Mesh, -Size, Size, GREEN, true );
+
+    const float Half = 50.f * SimScale;
+    const float Line = 1.f;
+
+    addRectangle( Mesh, -Half, -Half, Half, -Half + Line, BLUE );
+    addRectangle( Mesh, -Half, Half - Line, Half, Half, BLUE );
+    addRectangle( Mesh, -Half, -Half + Line, -Half + Line, Half - Line, BLUE );
+    addRectangle( Mesh, Half - Line, -Half + Line, Half, Half - Line, BLUE );
+
+    return Mesh;
+}
+
+} // namespace
+
+FlockRenderer::FlockRenderer( const Boid& Prototype ) {
+    Shader = rlLoadShaderCode( VertexShaderCode, FragmentShaderCode );
+    // raylib hands back its default shader when compiling fails
+    if ( Shader == rlGetShaderIdDefault() ) Shader = 0;
+
+    Vao = rlLoadVertexArray();
+
+    if ( !isReady() ) {
+        Trace::message( "FlockRenderer: instancing unavailable, using the "
+                        "legacy draw path" );
+        return;
+    }
+
+    MvpLocation = rlGetLocationUniform( Shader, "mvp" );
+    InterpolationLocation = rlGetLocationUniform( Shader, "interpolation" );
+
+    const std::vector< MeshVertex > Mesh = buildMesh( Prototype );
+    MeshVertexCount = static_cast< int >( Mesh.size() );
+
+    rlEnableVertexArray( Vao );
+
+    MeshVbo = rlLoadVertexBuffer(
+        Mesh.data(), static_cast< int >( Mesh.size() * sizeof( MeshVertex ) ),
+        false );
+
+    const int Stride = static_cast< int >( sizeof( MeshVertex ) );
+
+    const int OffsetLocation = rlGetLocationAttrib( Shader, "meshOffset" );
+    const int ColorLocation = rlGetLocationAttrib( Shader, "meshColor" );
+    const int RotatesLocation = rlGetLocationAttrib( Shader, "meshRotates" );
+
+    if ( OffsetLocation >= 0 ) {
+        rlSetVertexAttribute( OffsetLocation, 2, RL_FLOAT, false, Stride,
+                              nullptr );
+        rlEnableVertexAttribute( OffsetLocation );
+    }
+
+    if ( ColorLocation >= 0 ) {
+        rlSetVertexAttribute(
+            ColorLocation, 4, RL_FLOAT, false, Stride,
+            reinterpret_cast< const void* >( offsetof( MeshVertex, R ) ) );
+        rlEnableVertexAttribute( ColorLocation );
+    }
+
+    if ( RotatesLocation >= 0 ) {
+        const size_t RotatesOffset = offsetof( MeshVertex, Rotates );
+        rlSetVertexAttribute(
+            RotatesLocation, 1, RL_FLOAT, false, Stride,
+            reinterpret_cast< const void* >( RotatesOffset ) );
+        rlEnableVertexAttribute( RotatesLocation );
+    }
+
+    rlDisableVertexArray();
+
+    for ( size_t a = 0; a < InstanceAttributes.size(); ++a ) {
+        InstanceLocations[a] =
+            rlGetLocationAttrib( Shader, InstanceAttributes[a] );
+    }
+}
+
+FlockRenderer::~FlockRenderer() {
+    for ( const unsigned Vbo : InstanceVbos ) {
+        if ( Vbo != 0 ) rlUnloadVertexBuffer( Vbo );
+    }
+
+    if ( MeshVbo != 0 ) rlUnloadVertexBuffer( MeshVbo );
+    if ( Vao != 0 ) rlUnloadVertexArray( Vao );
+    if ( Shader != 0 ) rlUnloadShaderProgram( Shader );
+}
+
+void FlockRenderer::reserve( const size_t Count ) {
+    if ( Count <= Capacity ) return;
+
+    Capacity = std::max( Count, Capacity * 2 );
+
+    const int Size = static_cast< int >( Capacity * sizeof( float ) );
+
+    rlEnableVertexArray( Vao );
+
+    for ( size_t a = 0; a < InstanceVbos.size(); ++a ) {
+        if ( InstanceVbos[a] != 0 ) rlUnloadVertexBuffer( InstanceVbos[a] );
+
+        InstanceVbos[a] = rlLoadVertexBuffer( nullptr, Size, true );
+
+        const int Location = InstanceLocations[a];
+        if ( Location < 0 ) continue;
+
+        rlSetVertexAttribute( Location, 1, RL_FLOAT, false, 0, nullptr );
+        rlSetVertexAttributeDivisor( Location, 1 );
+        rlEnableVertexAttribute( Location );
+    }
+
+    rlDisableVertexArray();
+}
+
+void FlockRenderer::draw( const BoidStore& Store,
+                          const float Interpolation ) {
+    BOIDS_ZONE( "Draw boids instanced" );
+
+    const size_t Count = Store.size();
+    if ( Count == 0 || !isReady() ) return;
+
+    reserve( Count );
+
+    const std::array< const float*, 4 > Sources = {
+        Store.PositionX.data(), Store.PositionY.data(), Store.VelocityX.data(),
+        Store.VelocityY.data() };
+
+    const int Size = static_cast< int >( Count * sizeof( float ) );
+
+    for ( size_t a = 0; a < InstanceVbos.size(); ++a ) {
+        rlUpdateVertexBuffer( InstanceVbos[a], Sources[a], Size, 0 );
+    }
+
+    // Keep ordering with whatever raylib has batched so far
+    rlDrawRenderBatchActive();
+
+    const Matrix Mvp =
+        MatrixMultiply( rlGetMatrixModelview(), rlGetMatrixProjection() );
+
+    rlDisableBackfaceCulling();
+    rlEnableShader( Shader );
+    rlSetUniformMatrix( MvpLocation, Mvp );
+    rlSetUniform( InterpolationLocation, &Interpolation,
+                  RL_SHADER_UNIFORM_FLOAT, 1 );
+
+    rlEnableVertexArray( Vao );
+    rlDrawVertexArrayInstanced( 0, MeshVertexCount,
+                                static_cast< int >( Count ) );
+    rlDisableVertexArray();
+
+    rlDisableShader();
+    rlEnableBackfaceCulling();
+}
+
+void RenderComparison::start( const size_t FramesPerPath_ ) {
+    FramesPerPath = std::max< size_t >( FramesPerPath_, 1 );
+    Frames = 0;
+
+    FrameTime = {};
+    DrawTime = {};
+
+    Phase = P_Legacy;
+}
+
+void RenderComparison::beginDraw() {
+    DrawStart = std::chrono::steady_clock::now();
+}
+
+void RenderComparison::endDraw() {
+    if ( Phase == P_Idle ) return;
+
+    const std::chrono::duration< double, std::milli > Duration =
+        std::chrono::steady_clock::now() - DrawStart;
+
+    DrawTime[Phase == P_Legacy ? 0 : 1] += Duration.count();
+}
+
+void RenderComparison::endFrame( const float DeltaTime ) {
+    if ( Phase == P_Idle ) return;
+
+    FrameTime[Phase == P_Legacy ? 0 : 1] += DeltaTime * 1000.0;
+
+    if ( ++Frames < FramesPerPath ) return;
+
+    Frames = 0;
+
+    if ( Phase == P_Legacy ) {
+        Phase = P_Instanced;
+        return;
+    }
+
+    Phase = P_Idle;
+    report();
+}
+
+void RenderComparison::report() const {
+    const double Count = static_cast< double >( FramesPerPath );
+
+    Trace::message( fmt::format(
+        "{:>24}: frame {:.3f} ms, draw {:.3f} ms", "Legacy draw",
+        FrameTime[0] / Count, DrawTime[0] / Count ) );
+    Trace::message( fmt::format(
+        "{:>24}: frame {:.3f} ms, draw {:.3f} ms", "Instanced draw",
+        FrameTime[1] / Count, DrawTime[1] / Count ) );
+}
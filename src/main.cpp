@@ -1,7 +1,10 @@
 
 #include <chrono>
+#include <memory>
+#include <string_view>
 
 #include "raylib.h"
+#include "rlgl.h"
 
 #include <fmt/core.h>
 
@@ -15,14 +18,30 @@ constexpr int HEIGHT = 720;
 
 #include "boid.hpp"
 #include "boid_manager.hpp"
+#include "flock_renderer.hpp"
+#include "performance_panel.hpp"
+#include "quadtree_overlay.hpp"
+#include "replay_panel.hpp"
+#include "simulation_thread.hpp"
+#include "trajectory_recorder.hpp"
+#include "trajectory_replay.hpp"
 
 #include "timer.hpp"
+#include "zone_profiler.hpp"
 
 #include "editor.hpp"
 
-int main( int, char** ) {
+int main( int Argc, char** Argv ) {
     setupDump();
 
+    // boids --replay PATH plays a recorded trajectory instead of simulating
+    TrajectoryReplay Replay;
+    if ( Argc > 2 && std::string_view( Argv[1] ) == "--replay" &&
+         !Replay.open( Argv[2] ) )
+        return 1;
+
+    const bool Replaying = Replay.isOpen();
+
     InitWindow( WIDTH, HEIGHT, "basic window" );
 
     TimeManager Time;
@@ -31,8 +50,44 @@ int main( int, char** ) {
 
     Profiler Profiler( 100000 );
 
-    BoidManager BoidManagerInstance( Vector2(
-        static_cast< float >( WIDTH ), static_cast< float >( HEIGHT ) ) );
+    const Boid Prototype = BoidManager::makePrototype();
+
+    auto Renderer = std::make_unique< FlockRenderer >( Prototype );
+    RenderComparison Comparison;
+    bool LegacyDraw = false;
+
+    auto Overlay = std::make_unique< QuadtreeOverlay >();
+
+    // Toggled with R, only copies the flock while recording
+    TrajectoryRecorder Recorder;
+
+    Editor::instance().initialize( GetWindowHandle() );
+
+    // Only built when simulating, a replay has no use for the flock or the
+    // thread pool
+    std::unique_ptr< BoidManager > Manager;
+    // Owns Manager while running, toggled with T
+    std::unique_ptr< SimulationThread > Simulation;
+    std::unique_ptr< PerformancePanel > Panel;
+    std::unique_ptr< ReplayPanel > Replayer;
+
+    if ( Replaying ) {
+        Replayer = std::make_unique< ReplayPanel >( Replay );
+        Editor::instance().addDisplayMenuCallback(
+            [&Replayer]() { Replayer->display(); } );
+    } else {
+        Manager = std::make_unique< BoidManager >( Vector2(
+            static_cast< float >( WIDTH ), static_cast< float >( HEIGHT ) ) );
+
+        Simulation = std::make_unique< SimulationThread >( *Manager );
+        Simulation->setRecorder( &Recorder );
+
+        Panel = std::make_unique< PerformancePanel >( *Manager, *Simulation );
+        Editor::instance().addDisplayMenuCallback(
+            [&Panel]() { Panel->display(); } );
+    }
+
+    BOIDS_ZONE_THREAD( "Main" );
 
     while ( !WindowShouldClose() ) {
         Time.update();
@@ -43,33 +98,140 @@ int main( int, char** ) {
 
         while ( Time.needsFixedUpdate() ) {
             // Fixed update here
+            if ( Replaying ) {
+                Replayer->update();
+                continue;
+            }
+
+            if ( Simulation->isRunning() ) continue;
 
-            // BoidManagerInstance.updateThread();
-            BoidManagerInstance.updateTree();
+            // Picked in the performance panel, updateTree by default
+            ( Manager.get()->*Simulation->getUpdate() )();
+            Recorder.record( Manager->getStore(),
+                             Manager->getTickStats().Tick );
         }
 
         // Frame update here
+        if ( Replaying ) {
+            if ( IsKeyPressed( KEY_SPACE ) ) Replayer->togglePlaying();
+            if ( IsKeyPressed( KEY_LEFT ) ) Replayer->step( -1 );
+            if ( IsKeyPressed( KEY_RIGHT ) ) Replayer->step( 1 );
+        } else {
+            if ( IsKeyPressed( KEY_T ) ) {
+                if ( Simulation->isRunning() )
+                    Simulation->stop();
+                else
+                    Simulation->start();
+            }
+
+            if ( IsKeyPressed( KEY_G ) ) {
+                Simulation->post( []( BoidManager& Manager ) {
+                    Manager.setNeighbourBackend(
+                        Manager.getNeighbourBackend() == B_Quadtree
+                            ? B_CellGrid
+                            : B_Quadtree );
+                } );
+            }
+
+            if ( IsKeyPressed( KEY_D ) ) {
+                Simulation->post( []( BoidManager& Manager ) {
+                    Manager.setDoubleBuffered( !Manager.getDoubleBuffered() );
+                } );
+            }
+
+            if ( IsKeyPressed( KEY_R ) ) {
+                if ( Recorder.isRecording() )
+                    Recorder.stop();
+                else
+                    Recorder.start( "boids_trajectory.bin",
+                                    Manager->getBounds() );
+            }
+
+            if ( IsKeyPressed( KEY_F5 ) ) {
+                Simulation->post( []( BoidManager& Manager ) {
+                    Manager.saveCheckpoint( "boids_checkpoint.bin" );
+                } );
+            }
+
+            if ( IsKeyPressed( KEY_F9 ) ) {
+                Simulation->post( []( BoidManager& Manager ) {
+                    Manager.loadCheckpoint( "boids_checkpoint.bin" );
+                } );
+            }
+        }
+
+#ifdef BOIDS_ENABLE_ZONES
+        if ( IsKeyPressed( KEY_P ) )
+            ZoneProfiler::exportChromeTrace( "boids_trace.json" );
+#endif
+
+        if ( IsKeyPressed( KEY_I ) ) LegacyDraw = !LegacyDraw;
+        if ( IsKeyPressed( KEY_B ) ) Comparison.start();
+
+        if ( IsKeyPressed( KEY_O ) )
+            Overlay->setEnabled( !Overlay->isEnabled() );
+        if ( IsKeyPressed( KEY_LEFT_BRACKET ) ) Overlay->stepMaxDepth( -1 );
+        if ( IsKeyPressed( KEY_RIGHT_BRACKET ) ) Overlay->stepMaxDepth( 1 );
+
+        BOIDS_ZONE( "Frame" );
 
         BeginDrawing();
         ClearBackground( DARKGRAY );
 
-        auto& Quads = BoidManagerInstance.getQuadtree()->getNodes();
+        // Draw here
+        const BoidStore* Boids = nullptr;
+        float Interpolation = 1.f;
+
+        if ( Replaying ) {
+            // Only build the replay's tree when it will be drawn
+            Boids = &Replay.getStore();
+            if ( Overlay->isEnabled() ) Overlay->draw( Replay.getQuadtree() );
+        } else if ( Simulation->isRunning() ) {
+            const FlockSnapshot* Snapshot = Simulation->acquire();
+
+            if ( Snapshot != nullptr ) {
+                Boids = &Snapshot->Store;
+                Interpolation = Simulation->getInterpolation( *Snapshot );
+                Overlay->draw( Snapshot->Nodes, Snapshot->TreeRevision );
+                Panel->record( Snapshot->Stats );
+            }
+        } else {
+            Boids = &Manager->getStore();
+            Overlay->draw( *Manager->getQuadtree() );
+            Panel->record( Manager->getTickStats() );
+        }
+
+        Editor::instance().update();
+
+        const bool Legacy = Comparison.isRunning() ? Comparison.useLegacy()
+                                                   : LegacyDraw;
 
-        for ( const auto& Q : Quads ) {
-            const float HalfWidth = Q->Size / 2.f;
-            const Vector2 Pos = Vector2SubtractValue( Q->Center, HalfWidth );
+        Comparison.beginDraw();
 
-            DrawRectangleLinesEx( { Pos.x, Pos.y, Q->Size, Q->Size }, 1.f,
-                                  RED );
+        if ( Boids != nullptr ) {
+            if ( Legacy || !Renderer->isReady() )
+                BoidManager::draw( Prototype, *Boids, Interpolation );
+            else
+                Renderer->draw( *Boids, Interpolation );
         }
 
-        // Draw here
-        BoidManagerInstance.draw();
+        Comparison.endDraw();
+
+        // ImGui draws straight to GL, flush rlgl's batch first
+        rlDrawRenderBatchActive();
+        Editor::instance().render();
 
         EndDrawing();
+
+        Comparison.endFrame( Time.getDeltaTime() );
     }
 
     // Shutdown
+    if ( Simulation ) Simulation->stop();
+    Recorder.stop();
+    Renderer.reset();
+    Overlay.reset();
+    Editor::instance().shutdown();
 
     CloseWindow();
 
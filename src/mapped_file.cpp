@@ -0,0 +1,152 @@
+
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.hpp"
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile( MappedFile&& Other ) noexcept {
+    *this = std::move( Other );
+}
+
+MappedFile& MappedFile::operator=( MappedFile&& Other ) noexcept {
+    if ( this == &Other ) return *this;
+
+    close();
+
+    Data = std::exchange( Other.Data, nullptr );
+    Size = std::exchange( Other.Size, 0 );
+
+#ifdef _WIN32
+    File = std::exchange( Other.File, nullptr );
+    Mapping = std::exchange( Other.Mapping, nullptr );
+#endif
+
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open( const std::string& Path ) {
+    close();
+
+    HANDLE Handle = CreateFileA( Path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                 nullptr, OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL, nullptr );
+    if ( Handle == INVALID_HANDLE_VALUE ) return false;
+
+    LARGE_INTEGER FileSize;
+    if ( !GetFileSizeEx( Handle, &FileSize ) || FileSize.QuadPart == 0 ) {
+        CloseHandle( Handle );
+        return false;
+    }
+
+    HANDLE View =
+        CreateFileMappingA( Handle, nullptr, PAGE_READONLY, 0, 0, nullptr );
+    if ( View == nullptr ) {
+        CloseHandle( Handle );
+        return false;
+    }
+
+    void* Address = MapViewOfFile( View, FILE_MAP_READ, 0, 0, 0 );
+    if ( Address == nullptr ) {
+        CloseHandle( View );
+        CloseHandle( Handle );
+        return false;
+    }
+
+    File = Handle;
+    Mapping = View;
+    Data = static_cast< const std::byte* >( Address );
+    Size = static_cast< size_t >( FileSize.QuadPart );
+
+    return true;
+}
+
+void MappedFile::prefetch( const size_t Offset, const size_t Length ) const {
+    if ( Offset >= Size ) return;
+
+    WIN32_MEMORY_RANGE_ENTRY Range;
+    Range.VirtualAddress = const_cast< std::byte* >( Data + Offset );
+    Range.NumberOfBytes = std::min( Length, Size - Offset );
+
+    PrefetchVirtualMemory( GetCurrentProcess(), 1, &Range, 0 );
+}
+
+void MappedFile::close() {
+    if ( Data != nullptr ) UnmapViewOfFile( Data );
+    if ( Mapping != nullptr ) CloseHandle( Mapping );
+    if ( File != nullptr ) CloseHandle( File );
+
+    Data = nullptr;
+    Size = 0;
+    File = nullptr;
+    Mapping = nullptr;
+}
+
+#else
+
+bool MappedFile::open( const std::string& Path ) {
+    close();
+
+    const int Descriptor = ::open( Path.c_str(), O_RDONLY );
+    if ( Descriptor < 0 ) return false;
+
+    struct stat Info;
+    if ( fstat( Descriptor, &Info ) != 0 || Info.st_size == 0 ) {
+        ::close( Descriptor );
+        return false;
+    }
+
+    const size_t Length = static_cast< size_t >( Info.st_size );
+    void* Address =
+        mmap( nullptr, Length, PROT_READ, MAP_PRIVATE, Descriptor, 0 );
+
+    // The mapping keeps the file alive on its own
+    ::close( Descriptor );
+
+    if ( Address == MAP_FAILED ) return false;
+
+    Data = static_cast< const std::byte* >( Address );
+    Size = Length;
+
+    return true;
+}
+
+void MappedFile::prefetch( const size_t Offset, const size_t Length ) const {
+    if ( Offset >= Size ) return;
+
+    // madvise wants a page aligned start
+    const size_t Page = static_cast< size_t >( sysconf( _SC_PAGESIZE ) );
+    const size_t Begin = Offset - Offset % Page;
+    const size_t End = Offset + std::min( Length, Size - Offset );
+
+    madvise( const_cast< std::byte* >( Data + Begin ), End - Begin,
+             MADV_WILLNEED );
+}
+
+void MappedFile::close() {
+    if ( Data != nullptr )
+        munmap( const_cast< std::byte* >( Data ), Size );
+
+    Data = nullptr;
+    Size = 0;
+}
+
+#endif
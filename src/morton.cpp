@@ -0,0 +1,44 @@
+
+#include <array>
+
+#include "morton.hpp"
+
+void Morton::radixSort( std::vector< uint32_t >& Keys,
+                        std::vector< unsigned >& Values,
+                        std::vector< uint32_t >& KeyScratch,
+                        std::vector< unsigned >& ValueScratch ) {
+    const size_t Count = Keys.size();
+
+    KeyScratch.resize( Count );
+    ValueScratch.resize( Count );
+
+    for ( unsigned Shift = 0; Shift < 32; Shift += 8 ) {
+        std::array< size_t, 257 > Offsets{};
+
+        for ( size_t i = 0; i < Count; ++i ) {
+            Offsets[( ( Keys[i] >> Shift ) & 0xff ) + 1] += 1;
+        }
+
+        // Every key shares this byte, nothing to move
+        bool Skip = false;
+        for ( size_t b = 1; b < Offsets.size(); ++b ) {
+            if ( Offsets[b] == Count ) Skip = true;
+        }
+        if ( Skip ) continue;
+
+        for ( size_t b = 1; b < Offsets.size(); ++b ) {
+            Offsets[b] += Offsets[b - 1];
+        }
+
+        for ( size_t i = 0; i < Count; ++i ) {
+            const size_t Bucket = ( Keys[i] >> Shift ) & 0xff;
+            const size_t Target = Offsets[Bucket]++;
+
+            KeyScratch[Target] = Keys[i];
+            ValueScratch[Target] = Values[i];
+        }
+
+        Keys.swap( KeyScratch );
+        Values.swap( ValueScratch );
+    }
+}
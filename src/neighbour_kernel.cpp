@@ -0,0 +1,504 @@
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "neighbour_kernel.hpp"
+
+#if defined( __x86_64__ ) || defined( _M_X64 )
+#define NEIGHBOUR_KERNEL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined( NEIGHBOUR_KERNEL_X86 ) && !defined( _MSC_VER )
+#define KERNEL_TARGET( Isa ) __attribute__( ( target( Isa ) ) )
+#else
+#define KERNEL_TARGET( Isa )
+#endif
+
+namespace {
+
+struct Candidates {
+    const float* X;
+    const float* Y;
+    const float* VelocityX;
+    const float* VelocityY;
+    size_t Count;
+};
+
+struct Query {
+    float X;
+    float Y;
+    float RadiusSqr;
+    float AvoidSqr;
+};
+
+// Partial sums kept apart from BoidsUpdateValues so every path adds into
+// Values the same way
+struct Sums {
+    float VelocityX = 0.f;
+    float VelocityY = 0.f;
+    float PositionX = 0.f;
+    float PositionY = 0.f;
+    float AvoidX = 0.f;
+    float AvoidY = 0.f;
+    size_t Count = 0;
+};
+
+// 10 / Clamp( Distance, 0.001, 100 ) / Distance, in terms of 1 / Distance
+constexpr float AvoidStrength = 10.f;
+constexpr float MinInvDistance = 0.01f;
+constexpr float MaxInvDistance = 1000.f;
+
+void accumulateScalar( const Candidates& C, size_t Begin, const Query& Q,
+                       Sums& S ) {
+    for ( size_t i = Begin; i < C.Count; ++i ) {
+        const float Dx = C.X[i] - Q.X;
+        const float Dy = C.Y[i] - Q.Y;
+        const float DistanceSqr = Dx * Dx + Dy * Dy;
+
+        if ( DistanceSqr >= Q.RadiusSqr ) continue;
+
+        S.Count += 1;
+        S.VelocityX += C.VelocityX[i];
+        S.VelocityY += C.VelocityY[i];
+        S.PositionX += C.X[i];
+        S.PositionY += C.Y[i];
+
+        // Coincident boids have no direction to push along
+        if ( DistanceSqr >= Q.AvoidSqr || DistanceSqr <= 0.f ) continue;
+
+        const float InvDistance = 1.f / std::sqrt( DistanceSqr );
+        const float Scale =
+            AvoidStrength *
+            std::clamp( InvDistance, MinInvDistance, MaxInvDistance ) *
+            InvDistance;
+
+        S.AvoidX -= Dx * Scale;
+        S.AvoidY -= Dy * Scale;
+    }
+}
+
+#ifdef NEIGHBOUR_KERNEL_X86
+
+float horizontalSum( const float* Lanes, const size_t Width ) {
+    float Sum = 0.f;
+    for ( size_t l = 0; l < Width; ++l ) {
+        Sum += Lanes[l];
+    }
+    return Sum;
+}
+
+void accumulateSse( const Candidates& C, const Query& Q, Sums& S ) {
+    const __m128 X = _mm_set1_ps( Q.X );
+    const __m128 Y = _mm_set1_ps( Q.Y );
+    const __m128 RadiusSqr = _mm_set1_ps( Q.RadiusSqr );
+    const __m128 AvoidSqr = _mm_set1_ps( Q.AvoidSqr );
+    const __m128 Zero = _mm_setzero_ps();
+    const __m128 One = _mm_set1_ps( 1.f );
+    const __m128 Half = _mm_set1_ps( 0.5f );
+    const __m128 ThreeHalves = _mm_set1_ps( 1.5f );
+    const __m128 Strength = _mm_set1_ps( AvoidStrength );
+    const __m128 MinInv = _mm_set1_ps( MinInvDistance );
+    const __m128 MaxInv = _mm_set1_ps( MaxInvDistance );
+    const __m128 Tiny = _mm_set1_ps( 1e-30f );
+
+    __m128 Count = Zero;
+    __m128 VelocityX = Zero, VelocityY = Zero;
+    __m128 PositionX = Zero, PositionY = Zero;
+    __m128 AvoidX = Zero, AvoidY = Zero;
+
+    size_t i = 0;
+    for ( ; i + 4 <= C.Count; i += 4 ) {
+        const __m128 Px = _mm_loadu_ps( C.X + i );
+        const __m128 Py = _mm_loadu_ps( C.Y + i );
+
+        const __m128 Dx = _mm_sub_ps( Px, X );
+        const __m128 Dy = _mm_sub_ps( Py, Y );
+        const __m128 DistanceSqr =
+            _mm_add_ps( _mm_mul_ps( Dx, Dx ), _mm_mul_ps( Dy, Dy ) );
+
+        const __m128 Inside = _mm_cmplt_ps( DistanceSqr, RadiusSqr );
+        if ( _mm_movemask_ps( Inside ) == 0 ) continue;
+
+        Count = _mm_add_ps( Count, _mm_and_ps( Inside, One ) );
+        VelocityX = _mm_add_ps(
+            VelocityX, _mm_and_ps( Inside, _mm_loadu_ps( C.VelocityX + i ) ) );
+        VelocityY = _mm_add_ps(
+            VelocityY, _mm_and_ps( Inside, _mm_loadu_ps( C.VelocityY + i ) ) );
+        PositionX = _mm_add_ps( PositionX, _mm_and_ps( Inside, Px ) );
+        PositionY = _mm_add_ps( PositionY, _mm_and_ps( Inside, Py ) );
+
+        const __m128 Avoid =
+            _mm_and_ps( _mm_and_ps( Inside, _mm_cmplt_ps( DistanceSqr,
+                                                          AvoidSqr ) ),
+                        _mm_cmpgt_ps( DistanceSqr, Zero ) );
+        if ( _mm_movemask_ps( Avoid ) == 0 ) continue;
+
+        // One Newton step takes rsqrt from 12 to ~23 bits
+        const __m128 Clamped = _mm_max_ps( DistanceSqr, Tiny );
+        __m128 Inv = _mm_rsqrt_ps( Clamped );
+        Inv = _mm_mul_ps(
+            Inv, _mm_sub_ps( ThreeHalves,
+                             _mm_mul_ps( _mm_mul_ps( Half, Clamped ),
+                                         _mm_mul_ps( Inv, Inv ) ) ) );
+
+        const __m128 Scale = _mm_and_ps(
+            Avoid,
+            _mm_mul_ps( Strength,
+                        _mm_mul_ps( _mm_min_ps( _mm_max_ps( Inv, MinInv ),
+                                                MaxInv ),
+                                    Inv ) ) );
+
+        AvoidX = _mm_sub_ps( AvoidX, _mm_mul_ps( Dx, Scale ) );
+        AvoidY = _mm_sub_ps( AvoidY, _mm_mul_ps( Dy, Scale ) );
+    }
+
+    alignas( 16 ) float Lanes[4];
+
+    _mm_store_ps( Lanes, Count );
+    S.Count += static_cast< size_t >( horizontalSum( Lanes, 4 ) );
+    _mm_store_ps( Lanes, VelocityX );
+    S.VelocityX += horizontalSum( Lanes, 4 );
+    _mm_store_ps( Lanes, VelocityY );
+    S.VelocityY += horizontalSum( Lanes, 4 );
+    _mm_store_ps( Lanes, PositionX );
+    S.PositionX += horizontalSum( Lanes, 4 );
+    _mm_store_ps( Lanes, PositionY );
+    S.PositionY += horizontalSum( Lanes, 4 );
+    _mm_store_ps( Lanes, AvoidX );
+    S.AvoidX += horizontalSum( Lanes, 4 );
+    _mm_store_ps( Lanes, AvoidY );
+    S.AvoidY += horizontalSum( Lanes, 4 );
+
+    accumulateScalar( C, i, Q, S );
+}
+
+KERNEL_TARGET( "avx2,fma" )
+void accumulateAvx2( const Candidates& C, const Query& Q, Sums& S ) {
+    const __m256 X = _mm256_set1_ps( Q.X );
+    const __m256 Y = _mm256_set1_ps( Q.Y );
+    const __m256 RadiusSqr = _mm256_set1_ps( Q.RadiusSqr );
+    const __m256 AvoidSqr = _mm256_set1_ps( Q.AvoidSqr );
+    const __m256 Zero = _mm256_setzero_ps();
+    const __m256 Half = _mm256_set1_ps( 0.5f );
+    const __m256 ThreeHalves = _mm256_set1_ps( 1.5f );
+    const __m256 Strength = _mm256_set1_ps( AvoidStrength );
+    const __m256 MinInv = _mm256_set1_ps( MinInvDistance );
+    const __m256 MaxInv = _mm256_set1_ps( MaxInvDistance );
+    const __m256 Tiny = _mm256_set1_ps( 1e-30f );
+
+    size_t Count = 0;
+    __m256 VelocityX = Zero, VelocityY = Zero;
+    __m256 PositionX = Zero, PositionY = Zero;
+    __m256 AvoidX = Zero, AvoidY = Zero;
+
+    size_t i = 0;
+    for ( ; i + 8 <= C.Count; i += 8 ) {
+        const __m256 Px = _mm256_loadu_ps( C.X + i );
+        const __m256 Py = _mm256_loadu_ps( C.Y + i );
+
+        const __m256 Dx = _mm256_sub_ps( Px, X );
+        const __m256 Dy = _mm256_sub_ps( Py, Y );
+        const __m256 DistanceSqr =
+            _mm256_fmadd_ps( Dx, Dx, _mm256_mul_ps( Dy, Dy ) );
+
+        const __m256 Inside =
+            _mm256_cmp_ps( DistanceSqr, RadiusSqr, _CMP_LT_OQ );
+        const int InsideMask = _mm256_movemask_ps( Inside );
+        if ( InsideMask == 0 ) continue;
+
+        Count += static_cast< size_t >(
+            std::popcount( static_cast< unsigned >( InsideMask ) ) );
+        VelocityX = _mm256_add_ps(
+            VelocityX,
+            _mm256_and_ps( Inside, _mm256_loadu_ps( C.VelocityX + i ) ) );
+        VelocityY = _mm256_add_ps(
+            VelocityY,
+            _mm256_and_ps( Inside, _mm256_loadu_ps( C.VelocityY + i ) ) );
+        PositionX = _mm256_add_ps( PositionX, _mm256_and_ps( Inside, Px ) );
+        PositionY = _mm256_add_ps( PositionY, _mm256_and_ps( Inside, Py ) );
+
+        const __m256 Avoid = _mm256_and_ps(
+            _mm256_and_ps( Inside, _mm256_cmp_ps( DistanceSqr, AvoidSqr,
+                                                  _CMP_LT_OQ ) ),
+            _mm256_cmp_ps( DistanceSqr, Zero, _CMP_GT_OQ ) );
+        if ( _mm256_movemask_ps( Avoid ) == 0 ) continue;
+
+        const __m256 Clamped = _mm256_max_ps( DistanceSqr, Tiny );
+        __m256 Inv = _mm256_rsqrt_ps( Clamped );
+        Inv = _mm256_mul_ps(
+            Inv, _mm256_fnmadd_ps( _mm256_mul_ps( Half, Clamped ),
+                                   _mm256_mul_ps( Inv, Inv ), ThreeHalves ) );
+
+        const __m256 Scale = _mm256_and_ps(
+            Avoid, _mm256_mul_ps(
+                       Strength,
+                       _mm256_mul_ps( _mm256_min_ps(
+                                          _mm256_max_ps( Inv, MinInv ), MaxInv ),
+                                      Inv ) ) );
+
+        AvoidX = _mm256_fnmadd_ps( Dx, Scale, AvoidX );
+        AvoidY = _mm256_fnmadd_ps( Dy, Scale, AvoidY );
+    }
+
+    alignas( 32 ) float Lanes[8];
+
+    S.Count += Count;
+    _mm256_store_ps( Lanes, VelocityX );
+    S.VelocityX += horizontalSum( Lanes, 8 );
+    _mm256_store_ps( Lanes, VelocityY );
+    S.VelocityY += horizontalSum( Lanes, 8 );
+    _mm256_store_ps( Lanes, PositionX );
+    S.PositionX += horizontalSum( Lanes, 8 );
+    _mm256_store_ps( Lanes, PositionY );
+    S.PositionY += horizontalSum( Lanes, 8 );
+    _mm256_store_ps( Lanes, AvoidX );
+    S.AvoidX += horizontalSum( Lanes, 8 );
+    _mm256_store_ps( Lanes, AvoidY );
+    S.AvoidY += horizontalSum( Lanes, 8 );
+
+    accumulateScalar( C, i, Q, S );
+}
+
+KERNEL_TARGET( "avx512f" )
+void accumulateAvx512( const Candidates& C, const Query& Q, Sums& S ) {
+    const __m512 X = _mm512_set1_ps( Q.X );
+    const __m512 Y = _mm512_set1_ps( Q.Y );
+    const __m512 RadiusSqr = _mm512_set1_ps( Q.RadiusSqr );
+    const __m512 AvoidSqr = _mm512_set1_ps( Q.AvoidSqr );
+    const __m512 Zero = _mm512_setzero_ps();
+    const __m512 Half = _mm512_set1_ps( 0.5f );
+    const __m512 ThreeHalves = _mm512_set1_ps( 1.5f );
+    const __m512 Strength = _mm512_set1_ps( AvoidStrength );
+    const __m512 MinInv = _mm512_set1_ps( MinInvDistance );
+    const __m512 MaxInv = _mm512_set1_ps( MaxInvDistance );
+    const __m512 Tiny = _mm512_set1_ps( 1e-30f );
+
+    size_t Count = 0;
+    __m512 VelocityX = Zero, VelocityY = Zero;
+    __m512 PositionX = Zero, PositionY = Zero;
+    __m512 AvoidX = Zero, AvoidY = Zero;
+
+    // The tail runs through a mask instead of the scalar loop
+    for ( size_t i = 0; i < C.Count; i += 16 ) {
+        const size_t Remaining = C.Count - i;
+        const __mmask16 Valid =
+            Remaining >= 16
+                ? static_cast< __mmask16 >( 0xffff )
+                : static_cast< __mmask16 >( ( 1u << Remaining ) - 1 );
+
+        const __m512 Px = _mm512_maskz_loadu_ps( Valid, C.X + i );
+        const __m512 Py = _mm512_maskz_loadu_ps( Valid, C.Y + i );
+
+        const __m512 Dx = _mm512_sub_ps( Px, X );
+        const __m512 Dy = _mm512_sub_ps( Py, Y );
+        const __m512 DistanceSqr =
+            _mm512_fmadd_ps( Dx, Dx, _mm512_mul_ps( Dy, Dy ) );
+
+        const __mmask16 Inside = _mm512_mask_cmp_ps_mask(
+            Valid, DistanceSqr, RadiusSqr, _CMP_LT_OQ );
+        if ( Inside == 0 ) continue;
+
+        Count += static_cast< size_t >(
+            std::popcount( static_cast< unsigned >( Inside ) ) );
+        VelocityX = _mm512_mask_add_ps(
+            VelocityX, Inside, VelocityX,
+            _mm512_maskz_loadu_ps( Inside, C.VelocityX + i ) );
+        VelocityY = _mm512_mask_add_ps(
+            VelocityY, Inside, VelocityY,
+            _mm512_maskz_loadu_ps( Inside, C.VelocityY + i ) );
+        PositionX = _mm512_mask_add_ps( PositionX, Inside, PositionX, Px );
+        PositionY = _mm512_mask_add_ps( PositionY, Inside, PositionY, Py );
+
+        const __mmask16 Avoid =
+            _mm512_mask_cmp_ps_mask( Inside, DistanceSqr, AvoidSqr,
+                                     _CMP_LT_OQ ) &
+            _mm512_cmp_ps_mask( DistanceSqr, Zero, _CMP_GT_OQ );
+        if ( Avoid == 0 ) continue;
+
+        // rsqrt14 plus one Newton step
+        const __m512 Clamped = _mm512_max_ps( DistanceSqr, Tiny );
+        __m512 Inv = _mm512_rsqrt14_ps( Clamped );
+        Inv = _mm512_mul_ps(
+            Inv, _mm512_fnmadd_ps( _mm512_mul_ps( Half, Clamped ),
+                                   _mm512_mul_ps( Inv, Inv ), ThreeHalves ) );
+
+        const __m512 Scale = _mm512_mul_ps(
+            Strength,
+            _mm512_mul_ps(
+                _mm512_min_ps( _mm512_max_ps( Inv, MinInv ), MaxInv ), Inv ) );
+
+        AvoidX = _mm512_mask3_fnmadd_ps( Dx, Scale, AvoidX, Avoid );
+        AvoidY = _mm512_mask3_fnmadd_ps( Dy, Scale, AvoidY, Avoid );
+    }
+
+    S.Count += Count;
+    S.VelocityX += _mm512_reduce_add_ps( VelocityX );
+    S.VelocityY += _mm512_reduce_add_ps( VelocityY );
+    S.PositionX += _mm512_reduce_add_ps( PositionX );
+    S.PositionY += _mm512_reduce_add_ps( PositionY );
+    S.AvoidX += _mm512_reduce_add_ps( AvoidX );
+    S.AvoidY += _mm512_reduce_add_ps( AvoidY );
+}
+
+NeighbourKernel::Isa detectIsa() {
+#ifdef _MSC_VER
+    int Info[4];
+
+    __cpuid( Info, 1 );
+    const bool OsSaves = ( Info[2] & ( 1 << 27 ) ) != 0;
+    const bool Avx = ( Info[2] & ( 1 << 28 ) ) != 0;
+    const bool Fma = ( Info[2] & ( 1 << 12 ) ) != 0;
+
+    if ( !OsSaves || !Avx ) return NeighbourKernel::I_Sse;
+
+    const unsigned long long Xcr0 = _xgetbv( 0 );
+    if ( ( Xcr0 & 0x6 ) != 0x6 ) return NeighbourKernel::I_Sse;
+
+    __cpuidex( Info, 7, 0 );
+    const bool Avx2 = ( Info[1] & ( 1 << 5 ) ) != 0;
+    const bool Avx512 = ( Info[1] & ( 1 << 16 ) ) != 0;
+
+    if ( Avx512 && ( Xcr0 & 0xe6 ) == 0xe6 ) return NeighbourKernel::I_Avx512;
+    if ( Avx2 && Fma ) return NeighbourKernel::I_Avx2;
+#else
+    __builtin_cpu_init();
+
+    if ( __builtin_cpu_supports( "avx512f" ) ) return NeighbourKernel::I_Avx512;
+    if ( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+        return NeighbourKernel::I_Avx2;
+#endif
+
+    return NeighbourKernel::I_Sse;
+}
+
+#else
+
+NeighbourKernel::Isa detectIsa() { return NeighbourKernel::I_Scalar; }
+
+#endif
+
+const NeighbourKernel::Isa SupportedIsa = detectIsa();
+NeighbourKernel::Isa ActiveIsa = SupportedIsa;
+
+void dispatch( const Candidates& C, const Query& Q,
+               const NeighbourKernel::Isa Use, Sums& S ) {
+    switch ( Use ) {
+#ifdef NEIGHBOUR_KERNEL_X86
+    case NeighbourKernel::I_Avx512:
+        accumulateAvx512( C, Q, S );
+        return;
+    case NeighbourKernel::I_Avx2:
+        accumulateAvx2( C, Q, S );
+        return;
+    case NeighbourKernel::I_Sse:
+        accumulateSse( C, Q, S );
+        return;
+#endif
+    default:
+        accumulateScalar( C, 0, Q, S );
+        return;
+    }
+}
+
+void addSums( const Sums& S, BoidsUpdateValues& Values ) {
+    Values.Count += S.Count;
+    Values.AvgVelocity.x += S.VelocityX;
+    Values.AvgVelocity.y += S.VelocityY;
+    Values.AvgPosition.x += S.PositionX;
+    Values.AvgPosition.y += S.PositionY;
+    Values.AvgAvoid.x += S.AvoidX;
+    Values.AvgAvoid.y += S.AvoidY;
+}
+
+} // namespace
+
+NeighbourKernel::Isa NeighbourKernel::getSupportedIsa() {
+    return SupportedIsa;
+}
+
+NeighbourKernel::Isa NeighbourKernel::getIsa() { return ActiveIsa; }
+
+void NeighbourKernel::setIsa( const Isa Use ) {
+    ActiveIsa = std::min( Use, SupportedIsa );
+}
+
+const char* NeighbourKernel::getIsaName( const Isa Use ) {
+    switch ( Use ) {
+    case I_Sse:
+        return "SSE";
+    case I_Avx2:
+        return "AVX2";
+    case I_Avx512:
+        return "AVX-512";
+    default:
+        return "scalar";
+    }
+}
+
+void NeighbourKernel::accumulate( const BoidStore& Store, const size_t Begin,
+                                  const size_t End, const Vector2& Position,
+                                  const float Radius,
+                                  const float AvoidDistance,
+                                  BoidsUpdateValues& Values, const Isa Use ) {
+    if ( End <= Begin ) return;
+
+    const Candidates C{ Store.PositionX.data() + Begin,
+                        Store.PositionY.data() + Begin,
+                        Store.VelocityX.data() + Begin,
+                        Store.VelocityY.data() + Begin, End - Begin };
+    const Query Q{ Position.x, Position.y, Radius * Radius,
+                   AvoidDistance * AvoidDistance };
+
+    Sums S;
+    dispatch( C, Q, std::min( Use, SupportedIsa ), S );
+    addSums( S, Values );
+}
+
+void NeighbourKernel::accumulate( const BoidStore& Store,
+                                  const size_t* Indices, const size_t Count,
+                                  const size_t Exclude,
+                                  const Vector2& Position, const float Radius,
+                                  const float AvoidDistance,
+                                  BoidsUpdateValues& Values, const Isa Use ) {
+    // Query results are scattered, gather them into SoA blocks first
+    constexpr size_t BlockSize = 64;
+
+    alignas( 64 ) float X[BlockSize];
+    alignas( 64 ) float Y[BlockSize];
+    alignas( 64 ) float VelocityX[BlockSize];
+    alignas( 64 ) float VelocityY[BlockSize];
+
+    const Query Q{ Position.x, Position.y, Radius * Radius,
+                   AvoidDistance * AvoidDistance };
+    const Isa Active = std::min( Use, SupportedIsa );
+
+    Sums S;
+    size_t Filled = 0;
+
+    for ( size_t i = 0; i < Count; ++i ) {
+        const size_t Other = Indices[i];
+        if ( Other == Exclude ) continue;
+
+        X[Filled] = Store.PositionX[Other];
+        Y[Filled] = Store.PositionY[Other];
+        VelocityX[Filled] = Store.VelocityX[Other];
+        VelocityY[Filled] = Store.VelocityY[Other];
+
+        if ( ++Filled < BlockSize && i + 1 < Count ) continue;
+
+        dispatch( Candidates{ X, Y, VelocityX, VelocityY, Filled }, Q, Active,
+                  S );
+        Filled = 0;
+    }
+
+    if ( Filled > 0 )
+        dispatch( Candidates{ X, Y, VelocityX, VelocityY, Filled }, Q, Active,
+                  S );
+
+    addSums( S, Values );
+}
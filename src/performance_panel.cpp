@@ -0,0 +1,207 @@
+
+#include <algorithm>
+#include <cfloat>
+#include <string>
+
+#include "performance_panel.hpp"
+
+#include "imgui.h"
+
+#include <fmt/core.h>
+
+#include "editor.hpp"
+
+namespace {
+
+constexpr const char* UpdateNames[] = { "update", "updateThread",
+                                        "updateTree", "updateTreeThread" };
+
+constexpr SimulationThread::UpdateFunction Updates[] = {
+    &BoidManager::update, &BoidManager::updateThread, &BoidManager::updateTree,
+    &BoidManager::updateTreeThread };
+
+constexpr const char* BackendNames[] = { "Quadtree", "Cell grid" };
+
+} // namespace
+
+void PerformancePanel::History::push( const float Value ) {
+    Values[Offset] = Value;
+    Offset = ( Offset + 1 ) % HistoryLength;
+}
+
+float PerformancePanel::History::getLatest() const {
+    return Values[( Offset + HistoryLength - 1 ) % HistoryLength];
+}
+
+PerformancePanel::PerformancePanel( const BoidManager& Manager,
+                                    SimulationThread& Simulation_ )
+    : Simulation( Simulation_ ) {
+    const auto Current =
+        std::find( std::begin( Updates ), std::end( Updates ),
+                   Simulation.getUpdate() );
+    if ( Current != std::end( Updates ) )
+        UpdateIndex = static_cast< int >( Current - std::begin( Updates ) );
+
+    BackendIndex = Manager.getNeighbourBackend() == B_CellGrid ? 1 : 0;
+    LocalSize = Manager.getLocalSize();
+    Theta = Manager.getTheta();
+    Approximate = Manager.getApproximateTree();
+    Topological = Manager.getTopological();
+    TopologicalCount = static_cast< int >( Manager.getTopologicalCount() );
+}
+
+void PerformancePanel::record( const TickStats& Stats ) {
+    if ( HasStats && Stats.Tick == Latest.Tick ) return;
+
+    Latest = Stats;
+    HasStats = true;
+
+    TotalMs.push( Stats.TotalMs );
+    IndexMs.push( Stats.IndexMs );
+    VelocityMs.push( Stats.VelocityMs );
+    PositionMs.push( Stats.PositionMs );
+    if ( Stats.Allocations )
+        Allocations.push( static_cast< float >( *Stats.Allocations ) );
+}
+
+void PerformancePanel::plot( const char* Label, const History& Values,
+                             const char* Unit ) const {
+    const std::string Overlay =
+        fmt::format( "{} {:.2f} {}", Label, Values.getLatest(), Unit );
+
+    ImGui::PlotLines( fmt::format( "##{}", Label ).c_str(),
+                      Values.Values.data(), static_cast< int >( HistoryLength ),
+                      static_cast< int >( Values.Offset ), Overlay.c_str(),
+                      0.f, FLT_MAX, ImVec2( -1.f, 48.f ) );
+}
+
+void PerformancePanel::display() {
+    if ( !ImGui::Begin( "Performance" ) ) {
+        ImGui::End();
+        return;
+    }
+
+    if ( HasStats ) {
+        ImGui::TextUnformatted(
+            fmt::format( "Tick {}, {} boids", Latest.Tick, Latest.Count )
+                .c_str() );
+
+        if ( ImGui::CollapsingHeader( "Tick time",
+                                      ImGuiTreeNodeFlags_DefaultOpen ) ) {
+            plot( "Total", TotalMs, "ms" );
+            plot( "Index", IndexMs, "ms" );
+            plot( "Velocity", VelocityMs, "ms" );
+            plot( "Position", PositionMs, "ms" );
+        }
+
+        if ( ImGui::CollapsingHeader( "Neighbours",
+                                      ImGuiTreeNodeFlags_DefaultOpen ) ) {
+            ImGui::TextUnformatted(
+                fmt::format( "Tree: {} nodes, {} levels, peak {} nodes",
+                             Latest.NodeCount, Latest.TreeDepth,
+                             Latest.NodeHighWater )
+                    .c_str() );
+
+            std::array< float, 16 > Buckets{};
+            std::transform( Latest.NeighbourHistogram.begin(),
+                            Latest.NeighbourHistogram.end(), Buckets.begin(),
+                            []( const unsigned Value ) {
+                                return static_cast< float >( Value );
+                            } );
+
+            const std::string Overlay =
+                fmt::format( "{} neighbours per bar, mean {:.1f}",
+                             Latest.BucketWidth, Latest.NeighbourMean );
+            ImGui::PlotHistogram( "##Neighbours", Buckets.data(),
+                                  static_cast< int >( Buckets.size() ), 0,
+                                  Overlay.c_str(), 0.f, FLT_MAX,
+                                  ImVec2( -1.f, 64.f ) );
+        }
+
+        if ( ImGui::CollapsingHeader( "Threads",
+                                      ImGuiTreeNodeFlags_DefaultOpen ) ) {
+            for ( size_t t = 0; t < Latest.Utilisation.size(); ++t ) {
+                const float Busy = Latest.Utilisation[t];
+                ImGui::ProgressBar(
+                    Busy, ImVec2( -1.f, 0.f ),
+                    fmt::format( "{}: {:.0f}%", t, Busy * 100.f ).c_str() );
+            }
+        }
+
+        if ( ImGui::CollapsingHeader( "Allocations",
+                                      ImGuiTreeNodeFlags_DefaultOpen ) ) {
+            if ( Latest.Allocations ) {
+                plot( "Per tick", Allocations, "" );
+                ImGui::SameLine();
+                Editor::helpMarker( "Every operator new in the process while "
+                                    "the tick ran, render thread included." );
+            } else {
+                ImGui::TextDisabled(
+                    "Unavailable, build with BOIDS_COUNT_ALLOCATIONS" );
+            }
+        }
+    }
+
+    displayControls();
+
+    ImGui::End();
+}
+
+void PerformancePanel::displayControls() {
+    if ( !ImGui::CollapsingHeader( "Controls",
+                                   ImGuiTreeNodeFlags_DefaultOpen ) )
+        return;
+
+    if ( ImGui::Combo( "Update", &UpdateIndex, UpdateNames, 4 ) )
+        Simulation.setUpdate( Updates[UpdateIndex] );
+
+    if ( ImGui::Combo( "Index", &BackendIndex, BackendNames, 2 ) ) {
+        const NeighbourBackend Backend =
+            BackendIndex == 1 ? B_CellGrid : B_Quadtree;
+
+        Simulation.post( [Backend]( BoidManager& Manager ) {
+            Manager.setNeighbourBackend( Backend );
+        } );
+    }
+
+    if ( ImGui::SliderFloat( "LocalSize", &LocalSize, 5.f, 60.f, "%.1f" ) ) {
+        Simulation.post( [Value = LocalSize]( BoidManager& Manager ) {
+            Manager.setLocalSize( Value );
+        } );
+    }
+
+    if ( ImGui::Checkbox( "Barnes-Hut", &Approximate ) ) {
+        Simulation.post( [Value = Approximate]( BoidManager& Manager ) {
+            Manager.setApproximateTree( Value );
+        } );
+    }
+
+    // Below 0.1 almost no node is aggregated, past 1 the error grows fast
+    const bool ThetaChanged =
+        ImGui::SliderFloat( "Theta", &Theta, 0.1f, 1.f, "%.2f" );
+    ImGui::SameLine();
+    Editor::helpMarker( "Larger merges more distant boids into one, faster "
+                        "but less exact. Near 0.1 it is the exact rule at a "
+                        "higher cost, at 1 the mean velocity error is around 2 "
+                        "percent of the speed limit." );
+
+    if ( ThetaChanged ) {
+        Simulation.post( [Value = Theta]( BoidManager& Manager ) {
+            Manager.setTheta( Value );
+        } );
+    }
+
+    const bool TopologicalChanged =
+        ImGui::Checkbox( "Topological", &Topological );
+    ImGui::SameLine();
+    Editor::helpMarker( "Flock on the nearest boids instead of everyone "
+                        "within LocalSize. Quadtree index only." );
+
+    if ( ImGui::SliderInt( "Nearest", &TopologicalCount, 1, 32 ) ||
+         TopologicalChanged ) {
+        Simulation.post( [Enabled = Topological,
+                          Count = TopologicalCount]( BoidManager& Manager ) {
+            Manager.setTopological( Enabled, static_cast< size_t >( Count ) );
+        } );
+    }
+}
@@ -1,5 +1,8 @@
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
+#include <utility>
 
 #include <fmt/core.h>
 
@@ -10,9 +13,28 @@ void Quad::init() {
     Children = 0;
     Next = 0;
     Size = 0.f;
-    HalfSize = 0.f;
     BodyId = -1;
-    Body = nullptr;
+}
+
+Quad* Quad::createRoot( const BoidStore& Store, const float Padding ) {
+    Vector2 Min = Vector2{ std::numeric_limits< float >::max(),
+                           std::numeric_limits< float >::max() };
+    Vector2 Max = Vector2{ std::numeric_limits< float >::lowest(),
+                           std::numeric_limits< float >::lowest() };
+
+    for ( size_t i = 0; i < Store.size(); ++i ) {
+        Min.x = std::min( Min.x, Store.PositionX[i] );
+        Min.y = std::min( Min.y, Store.PositionY[i] );
+        Max.x = std::max( Max.x, Store.PositionX[i] );
+        Max.y = std::max( Max.y, Store.PositionY[i] );
+    }
+
+    Center = Vector2Add( Min, Max );
+    Center = Vector2Scale( Center, 0.5f );
+
+    Size = std::max( Max.x - Min.x, Max.y - Min.y ) + Padding * 2.f;
+
+    return this;
 }
 
 unsigned Quad::findQuad( const Vector2& Pos ) {
@@ -20,22 +42,19 @@ unsigned Quad::findQuad( const Vector2& Pos ) {
              static_cast< unsigned >( Pos.x > Center.x ) );
 }
 
-bool Quad::intersects( const Vector2& Pos, const float HalfSize_ ) const {
-    bool NotIntersects = ( Pos.x - HalfSize_ > Center.x + HalfSize ) ||
-                         ( Pos.x + HalfSize_ < Center.x - HalfSize ) ||
-                         ( Pos.y - HalfSize_ > Center.y + HalfSize ) ||
-                         ( Pos.y + HalfSize_ < Center.y - HalfSize );
+bool Quad::containsPoint( const Vector2& Pos ) const {
+    const float HalfSize = Size * 0.5f;
 
-    return !NotIntersects;
+    return Pos.x >= Center.x - HalfSize && Pos.x <= Center.x + HalfSize &&
+           Pos.y >= Center.y - HalfSize && Pos.y <= Center.y + HalfSize;
 }
 
 bool Quad::hasChildren() const { return Children != 0; }
 
 bool Quad::isEmpty() const { return BodyId == -1; }
 
-void Quad::subdivide( Quad* Parent, unsigned QuadrantId ) {
+void Quad::subdivide( const Quad* Parent, unsigned QuadrantId ) {
     Size = Parent->Size * 0.5f;
-    HalfSize = Size * 0.5f;
     Center.x = Parent->Center.x +
                ( static_cast< float >( QuadrantId & 1 ) - 0.5f ) * Size;
     Center.y = Parent->Center.y +
@@ -48,83 +67,563 @@ void Quad::printSimple( const unsigned Id ) const {
         Id, Children, Next, Size, BodyId ) );
 }
 
-Quadtree::Quadtree() : Mb( std::make_unique< MemoryBank >() ) {
+Quadtree::Quadtree() {
     Theta = 0.20f;
     SquareTheta = Theta * Theta;
 }
 
-Quadtree::~Quadtree() {
-    for ( auto& Node : Nodes ) {
-        Mb->store( std::move( Node ) );
-    }
-}
+Quadtree::~Quadtree() {}
 
 Quadtree::Quadtree( const Quadtree& ) {}
 
 Quadtree::Quadtree( Quadtree&& ) {}
 
-std::vector< Boid* > Quadtree::query( const Vector2& Pos,
-                                      const float HalfSize ) {
-    std::vector< Boid* > Targets;
+void Quadtree::initialize( const BoidStore& Store ) {
+    auto& RootNode = Nodes[Nodes.getBlock( 1 )];
+    RootNode.init();
+    RootNode.createRoot( Store, RootPadding );
+
+    BodyNodes.assign( Store.size(), NoNode );
+    // Sized up front, workers drop bodies concurrently
+    Twins.resize( Store.size() );
+}
+
+void Quadtree::build( const BoidStore& Store ) {
+    beginBuild( Store, 1 );
+    buildTasks( 0, 1 );
+    allocateTasks();
+    stitchTasks( 0, 1 );
+}
+
+bool Quadtree::update( const BoidStore& Store ) {
+    if ( Nodes.empty() ) return false;
+
+    const size_t Count = Store.size();
+    if ( BodyNodes.size() < Count ) BodyNodes.resize( Count, NoNode );
+
+    Moved.clear();
+
+    for ( size_t i = 0; i < Count; ++i ) {
+        const Vector2 Position = Store.getPosition( i );
+
+        // Anything leaving the root needs a full rebuild
+        if ( !contains( Position ) ) return false;
+
+        const unsigned Leaf = BodyNodes[i];
+
+        if ( Leaf == Dropped ) {
+            if ( !sharesSpot( Store, i ) )
+                Moved.push_back( static_cast< unsigned >( i ) );
+        } else if ( Leaf == NoNode || !Nodes[Leaf].containsPoint( Position ) ) {
+            Moved.push_back( static_cast< unsigned >( i ) );
+        }
+    }
+
+    if ( !ParentsValid ) {
+        Parents.assign( Nodes.size(), NoNode );
+
+        for ( unsigned n = 0; n < Nodes.size(); ++n ) {
+            if ( !Nodes[n].hasChildren() ) continue;
+
+            for ( unsigned c = Nodes[n].Children; c < Nodes[n].Children + 4;
+                  ++c ) {
+                Parents[c] = n;
+            }
+        }
+
+        ParentsValid = true;
+    }
+
+    Vacated.clear();
+
+    for ( const unsigned i : Moved ) {
+        if ( BodyNodes[i] != NoNode && BodyNodes[i] != Dropped )
+            Vacated.push_back( BodyNodes[i] );
+
+        remove( i );
+    }
+
+    for ( const unsigned i : Moved ) {
+        insert( Store, i );
+    }
+
+    // Fold away the subtrees the movers left behind
+    for ( const unsigned Leaf : Vacated ) {
+        const unsigned Parent = Parents[Leaf];
+
+        // The block holding Leaf may already have been folded
+        if ( Parent == NoNode || !Nodes[Parent].hasChildren() ||
+             Leaf < Nodes[Parent].Children ||
+             Leaf >= Nodes[Parent].Children + 4 )
+            continue;
+
+        collapse( Parent );
+    }
+
+    return true;
+}
+
+void Quadtree::collapse( unsigned NodeId ) {
+    while ( NodeId != NoNode ) {
+        Quad& Node = Nodes[NodeId];
+        if ( !Node.hasChildren() ) return;
+
+        int Body = -1;
+        unsigned Bodies = 0;
+
+        for ( unsigned c = Node.Children; c < Node.Children + 4; ++c ) {
+            if ( Nodes[c].hasChildren() ) return;
+
+            if ( !Nodes[c].isEmpty() ) {
+                Body = Nodes[c].BodyId;
+                Bodies += 1;
+            }
+        }
+
+        if ( Bodies > 1 ) return;
+
+        // Mark the block dead so getNodes() users can skip it
+        for ( unsigned c = Node.Children; c < Node.Children + 4; ++c ) {
+            Nodes[c].init();
+        }
+
+        Nodes.storeBlock( Node.Children );
+        Node.Children = 0;
+        Revision += 1;
+        Node.BodyId = Body;
+
+        if ( Body != -1 ) setBodyNode( static_cast< size_t >( Body ), NodeId );
+
+        NodeId = Parents[NodeId];
+    }
+}
+
+void Quadtree::beginBuild( const BoidStore& Store,
+                           const size_t WorkerCount ) {
+    clear();
+    initialize( Store );
+
+    BuildStore = &Store;
+
+    if ( WorkerNodes.size() < WorkerCount ) WorkerNodes.resize( WorkerCount );
+
+    // Leave a quarter extra once outgrown, so a spreading flock does not
+    // grow the arrays again every few ticks
+    const MemoryBank< Quad >::Stats Bank = Nodes.getStats();
+    const bool Outgrown =
+        Bank.Capacity < Bank.HighWater ||
+        std::any_of( WorkerNodes.begin(), WorkerNodes.end(),
+                     [&Bank]( const std::vector< Quad >& Local ) {
+                         return Local.capacity() < Bank.HighWater;
+                     } );
+    if ( Outgrown ) reserveNodes( Bank.HighWater + Bank.HighWater / 4 );
+
+    const unsigned Count = static_cast< unsigned >( Store.size() );
+    const unsigned KeyCount = 1u << ( 2 * SplitDepth );
+
+    // Counting sort of the slots by the quadrants they fall in for the top
+    // SplitDepth levels, using the same centers subdivide() will produce
+    BuildKeys.resize( Count );
+    KeyStart.assign( KeyCount + 1, 0 );
+
+    const Quad& RootNode = Nodes[Root];
+
+    for ( unsigned i = 0; i < Count; ++i ) {
+        const Vector2 Pos = Store.getPosition( i );
+
+        Quad Node = RootNode;
+        unsigned Key = 0;
+
+        for ( unsigned d = 0; d < SplitDepth; ++d ) {
+            const unsigned QuadrantId = Node.findQuad( Pos );
+            Key = ( Key << 2 ) | QuadrantId;
+
+            Quad Child;
+            Child.subdivide( &Node, QuadrantId );
+            Node = Child;
+        }
+
+        BuildKeys[i] = Key;
+        KeyStart[Key + 1] += 1;
+    }
+
+    for ( unsigned k = 0; k < KeyCount; ++k ) {
+        KeyStart[k + 1] += KeyStart[k];
+    }
+
+    BuildOrder.resize( Count );
+    BuildCursor.assign( KeyStart.begin(), KeyStart.end() - 1 );
+
+    for ( unsigned i = 0; i < Count; ++i ) {
+        BuildOrder[BuildCursor[BuildKeys[i]]++] = i;
+    }
+
+    Tasks.clear();
+    splitTop( Root, 0, 0, KeyCount );
+}
+
+void Quadtree::reserveNodes( const size_t Count ) {
+    Nodes.reserve( Count );
+
+    // Any one worker may end up building most of the tree
+    for ( std::vector< Quad >& Local : WorkerNodes ) {
+        Local.reserve( Count );
+    }
+}
+
+void Quadtree::splitTop( const unsigned NodeId, const unsigned Depth,
+                         const unsigned KeyBegin, const unsigned KeyEnd ) {
+    const unsigned Begin = KeyStart[KeyBegin];
+    const unsigned End = KeyStart[KeyEnd];
+    const unsigned Count = End - Begin;
+
+    if ( Count == 0 ) return;
+
+    // Like insert(), only the first of several bodies at one spot is kept
+    if ( Count == 1 || sameLocation( Begin, End ) ) {
+        Nodes[NodeId].BodyId = static_cast< int >( BuildOrder[Begin] );
+        setBodyNode( BuildOrder[Begin], NodeId );
+        dropBodies( Begin, End );
+        return;
+    }
+
+    if ( Depth == SplitDepth ) {
+        Tasks.push_back( BuildTask{ NodeId, Begin, End, Depth, 0, 0, 0 } );
+        return;
+    }
+
+    const unsigned ChildrenId = subdivide( NodeId );
+    const unsigned Span = ( KeyEnd - KeyBegin ) / 4;
+
+    for ( unsigned q = 0; q < 4; ++q ) {
+        splitTop( ChildrenId + q, Depth + 1, KeyBegin + q * Span,
+                  KeyBegin + ( q + 1 ) * Span );
+    }
+}
+
+void Quadtree::buildTasks( const size_t Worker, const size_t WorkerCount ) {
+    // The worker's tasks go one after another into its own cache
+    auto& Local = WorkerNodes[Worker];
+    Local.clear();
+
+    for ( size_t t = Worker; t < Tasks.size(); t += WorkerCount ) {
+        BuildTask& Task = Tasks[t];
+
+        Task.NodeBegin = static_cast< unsigned >( Local.size() );
+        buildChildren( Local, Nodes[Task.NodeId], NoNode, Task.Begin,
+                       Task.End, Task.Depth );
+        Task.NodeEnd = static_cast< unsigned >( Local.size() );
+    }
+}
+
+unsigned Quadtree::buildChildren( std::vector< Quad >& Local,
+                                  const Quad& Parent, const unsigned ParentNext,
+                                  const unsigned Begin, const unsigned End,
+                                  const unsigned Depth ) {
+    const unsigned ChildrenId = static_cast< unsigned >( Local.size() );
+
+    // Partition into quadrants in findQuad order
+    const BoidStore& Store = *BuildStore;
+    const Vector2 Center = Parent.Center;
+
+    auto* First = BuildOrder.data() + Begin;
+    auto* Last = BuildOrder.data() + End;
+
+    auto* Bottom = std::partition( First, Last, [&]( const unsigned i ) {
+        return !( Store.PositionY[i] > Center.y );
+    } );
+    auto* TopRight = std::partition( First, Bottom, [&]( const unsigned i ) {
+        return !( Store.PositionX[i] > Center.x );
+    } );
+    auto* BottomRight = std::partition( Bottom, Last, [&]( const unsigned i ) {
+        return !( Store.PositionX[i] > Center.x );
+    } );
+
+    const unsigned Bounds[5] = {
+        Begin, static_cast< unsigned >( TopRight - BuildOrder.data() ),
+        static_cast< unsigned >( Bottom - BuildOrder.data() ),
+        static_cast< unsigned >( BottomRight - BuildOrder.data() ), End };
+
+    for ( unsigned q = 0; q < 4; ++q ) {
+        Quad Child;
+        Child.init();
+        Child.subdivide( &Parent, q );
+        Child.Next = ( q < 3 ) ? ChildrenId + q + 1 : ParentNext;
+
+        Local.push_back( Child );
+    }
+
+    for ( unsigned q = 0; q < 4; ++q ) {
+        const unsigned Count = Bounds[q + 1] - Bounds[q];
+        const unsigned ChildId = ChildrenId + q;
+
+        const bool Stacked =
+            Count > 1 && sameLocation( Bounds[q], Bounds[q + 1] );
+
+        // Bodies stopped by MaxDepth alone stay NoNode, update() places them
+        if ( Count == 1 || Stacked || ( Count > 1 && Depth + 1 >= MaxDepth ) ) {
+            Local[ChildId].BodyId = static_cast< int >( BuildOrder[Bounds[q]] );
+            if ( Stacked ) dropBodies( Bounds[q], Bounds[q + 1] );
+        } else if ( Count > 1 ) {
+            const Quad Child = Local[ChildId];
+            const unsigned GrandChildrenId = buildChildren(
+                Local, Child, Child.Next, Bounds[q], Bounds[q + 1], Depth + 1 );
+            Local[ChildId].Children = GrandChildrenId;
+        }
+    }
+
+    return ChildrenId;
+}
+
+void Quadtree::dropBodies( const unsigned Begin, const unsigned End ) {
+    // Slots are distinct across tasks, so workers can write these directly
+    for ( unsigned i = Begin + 1; i < End; ++i ) {
+        BodyNodes[BuildOrder[i]] = Dropped;
+        Twins[BuildOrder[i]] = BuildOrder[Begin];
+    }
+}
+
+void Quadtree::dropBody( const size_t Index, const unsigned Twin ) {
+    setBodyNode( Index, Dropped );
+
+    if ( Index >= Twins.size() ) Twins.resize( Index + 1 );
+    Twins[Index] = Twin;
+}
+
+bool Quadtree::sharesSpot( const BoidStore& Store, const size_t Index ) const {
+    // The twin may have moved, been removed or been relabelled since
+    const unsigned Twin = Twins[Index];
+
+    if ( Twin >= Store.size() || BodyNodes[Twin] == NoNode ||
+         BodyNodes[Twin] == Dropped )
+        return false;
+
+    return Vector2Equals( Store.getPosition( Twin ),
+                          Store.getPosition( Index ) );
+}
+
+bool Quadtree::sameLocation( const unsigned Begin, const unsigned End ) const {
+    const BoidStore& Store = *BuildStore;
+    const unsigned First = BuildOrder[Begin];
+
+    for ( unsigned i = Begin + 1; i < End; ++i ) {
+        const unsigned Other = BuildOrder[i];
+
+        if ( Store.PositionX[Other] != Store.PositionX[First] ||
+             Store.PositionY[Other] != Store.PositionY[First] )
+            return false;
+    }
+
+    return true;
+}
+
+void Quadtree::allocateTasks() {
+    // Subtrees go one after another in task order, which is where the serial
+    // build puts them whichever worker built each one
+    unsigned Total = 0;
+    for ( BuildTask& Task : Tasks ) {
+        Task.NodeBase = Total;
+        Total += Task.NodeEnd - Task.NodeBegin;
+    }
+
+    const unsigned Base = Nodes.getBlock( Total );
+    for ( BuildTask& Task : Tasks ) {
+        Task.NodeBase += Base;
+    }
+
+    // Task subtrees do not record parents, rebuilt on the next update()
+    ParentsValid = false;
+}
+
+void Quadtree::stitchTasks( const size_t Worker, const size_t WorkerCount ) {
+    const auto& Local = WorkerNodes[Worker];
+
+    for ( size_t t = Worker; t < Tasks.size(); t += WorkerCount ) {
+        const BuildTask& Task = Tasks[t];
+
+        // Cache indices move to the task's place in the bank, links leaving
+        // the subtree continue at the task node's Next
+        const auto toBank = [&Task]( const unsigned LocalId ) {
+            return Task.NodeBase + ( LocalId - Task.NodeBegin );
+        };
+
+        Quad& TaskNode = Nodes[Task.NodeId];
+        TaskNode.Children = Task.NodeBase;
+
+        for ( unsigned i = Task.NodeBegin; i < Task.NodeEnd; ++i ) {
+            Quad& Node = Nodes[toBank( i )];
+            Node = Local[i];
+
+            if ( Node.hasChildren() ) Node.Children = toBank( Node.Children );
+
+            Node.Next = ( Node.Next == NoNode ) ? TaskNode.Next
+                                                : toBank( Node.Next );
+
+            if ( !Node.isEmpty() ) {
+                BodyNodes[static_cast< size_t >( Node.BodyId )] = toBank( i );
+            }
+        }
+    }
+}
+
+std::span< size_t > Quadtree::query( const BoidStore& Store,
+                                     const Vector2& Pos, const float Radius,
+                                     BumpArena& Arena ) const {
+    ArenaBuffer< size_t > Targets( Arena );
+
+    forEachInRadius( Store, Pos, Radius, [&Targets]( const size_t Target ) {
+        Targets.push_back( Target );
+    } );
+
+    return Targets.span();
+}
+
+namespace {
 
-    query( Targets, Nodes[Root].get(), Pos, HalfSize );
+// Node or body on one of the heaps of findNearest
+struct Candidate {
+    float DistanceSqr;
+    unsigned Id;
+};
 
-    return Targets;
+bool isNearer( const Candidate& A, const Candidate& B ) {
+    return A.DistanceSqr < B.DistanceSqr;
 }
 
-void Quadtree::query( std::vector< Boid* >& Targets, const Quad* Node,
-                      const Vector2& Pos, const float HalfSize ) {
-    if ( Node->intersects( Pos, HalfSize ) ) {
-        if ( Node->Body != nullptr ) Targets.push_back( Node->Body );
+bool isFarther( const Candidate& A, const Candidate& B ) {
+    return A.DistanceSqr > B.DistanceSqr;
+}
+
+float distanceToSquareSqr( const Quad& Node, const Vector2& Pos ) {
+    const float HalfSize = Node.Size * 0.5f;
+    const float Dx =
+        std::max( std::fabs( Pos.x - Node.Center.x ) - HalfSize, 0.f );
+    const float Dy =
+        std::max( std::fabs( Pos.y - Node.Center.y ) - HalfSize, 0.f );
+
+    return Dx * Dx + Dy * Dy;
+}
+
+} // namespace
+
+std::span< size_t > Quadtree::findNearest( const BoidStore& Store,
+                                           const Vector2& Pos, const size_t K,
+                                           const size_t Exclude,
+                                           BumpArena& Arena ) const {
+    // The output first, the node heap has to stay the latest allocation
+    size_t* Found = Arena.allocate< size_t >( K );
+    if ( Nodes.empty() || K == 0 ) return std::span< size_t >( Found, 0 );
+
+    // Max-heap of the best bodies so far, the K-th distance on top
+    Candidate* Best = Arena.allocate< Candidate >( K );
+    size_t Count = 0;
+
+    const auto offer = [&]( const Quad& Leaf ) {
+        const size_t Body = static_cast< size_t >( Leaf.BodyId );
+        if ( Body == Exclude ) return;
+
+        const float Bx = Store.PositionX[Body] - Pos.x;
+        const float By = Store.PositionY[Body] - Pos.y;
+        const Candidate Each{ Bx * Bx + By * By,
+                              static_cast< unsigned >( Body ) };
+
+        if ( Count < K ) {
+            Best[Count++] = Each;
+            std::push_heap( Best, Best + Count, isNearer );
+        } else if ( Each.DistanceSqr < Best[0].DistanceSqr ) {
+            std::pop_heap( Best, Best + K, isNearer );
+            Best[K - 1] = Each;
+            std::push_heap( Best, Best + K, isNearer );
+        }
+    };
+
+    // Min-heap of nodes still to expand, by distance to their square
+    ArenaBuffer< Candidate > Queue( Arena );
+    Queue.push_back( Candidate{ 0.f, Root } );
 
-        if ( Node->hasChildren() ) {
-            for ( unsigned i = Node->Children; i < Node->Children + 4; ++i ) {
-                query( Targets, Nodes[i].get(), Pos, HalfSize );
+    while ( !Queue.empty() ) {
+        std::pop_heap( Queue.begin(), Queue.end(), isFarther );
+        const Candidate Closest = Queue.back();
+        Queue.pop_back();
+
+        // Every node left is at least this far away
+        if ( Count == K && Closest.DistanceSqr >= Best[0].DistanceSqr ) break;
+
+        const Quad& Node = Nodes[Closest.Id];
+
+        if ( !Node.hasChildren() ) {
+            // Only a root without children gets here
+            if ( !Node.isEmpty() ) offer( Node );
+            continue;
+        }
+
+        for ( unsigned c = 0; c < 4; ++c ) {
+            const unsigned ChildId = Node.Children + c;
+            const Quad& Child = Nodes[ChildId];
+
+            if ( Child.hasChildren() ) {
+                const float DistanceSqr = distanceToSquareSqr( Child, Pos );
+
+                if ( Count < K || DistanceSqr < Best[0].DistanceSqr ) {
+                    Queue.push_back( Candidate{ DistanceSqr, ChildId } );
+                    std::push_heap( Queue.begin(), Queue.end(), isFarther );
+                }
+            } else if ( !Child.isEmpty() ) {
+                offer( Child );
             }
         }
     }
+
+    std::sort_heap( Best, Best + Count, isNearer );
+
+    for ( size_t i = 0; i < Count; ++i ) {
+        Found[i] = Best[i].Id;
+    }
+
+    return std::span< size_t >( Found, Count );
 }
 
-void Quadtree::insert( Boid* ThisBody ) {
+void Quadtree::insert( const BoidStore& Store, const size_t Index ) {
+    const Vector2 Position = Store.getPosition( Index );
+
     unsigned NodeId = 0;
 
     // Finding the smallest quadrant without children
-    while ( Nodes[NodeId]->hasChildren() ) {
-        unsigned QuadrantId =
-            Nodes[NodeId]->findQuad( ThisBody->getPosition() );
+    while ( Nodes[NodeId].hasChildren() ) {
+        unsigned QuadrantId = Nodes[NodeId].findQuad( Position );
 
-        NodeId = Nodes[NodeId]->Children + QuadrantId;
+        NodeId = Nodes[NodeId].Children + QuadrantId;
     }
 
     auto& CurrentNode = Nodes[NodeId];
 
-    // If Quadrant is empty insert ThisBody and return
-    if ( CurrentNode->isEmpty() ) {
-        CurrentNode->BodyId = static_cast< int >( ThisBody->getId() );
-        CurrentNode->Body = ThisBody;
+    // If Quadrant is empty insert Index and return
+    if ( CurrentNode.isEmpty() ) {
+        CurrentNode.BodyId = static_cast< int >( Index );
+        setBodyNode( Index, NodeId );
         return;
     }
 
     // Else if Quadrant is not empty
 
-    Boid* OtherBody = Nodes[NodeId]->Body;
-    const int Id = Nodes[NodeId]->BodyId;
+    const int Id = Nodes[NodeId].BodyId;
+    const Vector2 OtherPosition =
+        Store.getPosition( static_cast< size_t >( Id ) );
 
-    // If two bodies are in the same location
-    if ( Vector2Equals( OtherBody->getPosition(), ThisBody->getPosition() ) ) {
-        Trace::message( "In same location." );
+    // Only the first of two bodies at one spot is kept
+    if ( Vector2Equals( OtherPosition, Position ) ) {
+        dropBody( Index, static_cast< unsigned >( Id ) );
         return;
     }
 
-    Nodes[NodeId]->Body = nullptr;
-    Nodes[NodeId]->BodyId = -1;
+    Nodes[NodeId].BodyId = -1;
 
     // Break current Quadrant into four smaller quadrants
     while ( true ) {
         unsigned ChildrenId = subdivide( NodeId );
 
-        unsigned Q1 = Nodes[NodeId]->findQuad( OtherBody->getPosition() );
-        unsigned Q2 = Nodes[NodeId]->findQuad( ThisBody->getPosition() );
+        unsigned Q1 = Nodes[NodeId].findQuad( OtherPosition );
+        unsigned Q2 = Nodes[NodeId].findQuad( Position );
 
         if ( Q1 == Q2 )
             NodeId = ChildrenId + Q1;
@@ -132,43 +631,265 @@ void Quadtree::insert( Boid* ThisBody ) {
             unsigned N1 = ChildrenId + Q1;
             unsigned N2 = ChildrenId + Q2;
 
-            Nodes[N1]->BodyId = Id;
-            Nodes[N1]->Body = OtherBody;
+            Nodes[N1].BodyId = Id;
+            Nodes[N2].BodyId = static_cast< int >( Index );
 
-            Nodes[N2]->BodyId = static_cast< int >( ThisBody->getId() );
-            Nodes[N2]->Body = ThisBody;
+            setBodyNode( static_cast< size_t >( Id ), N1 );
+            setBodyNode( Index, N2 );
 
             return;
         }
     }
 }
 
+void Quadtree::remove( const size_t Index ) {
+    if ( Index >= BodyNodes.size() ) return;
+
+    const unsigned NodeId = BodyNodes[Index];
+    BodyNodes[Index] = NoNode;
+
+    if ( NodeId == NoNode || NodeId == Dropped ) return;
+
+    Nodes[NodeId].BodyId = -1;
+}
+
+void Quadtree::move( const size_t From, const size_t To ) {
+    if ( From >= BodyNodes.size() ) return;
+
+    const unsigned NodeId = BodyNodes[From];
+    BodyNodes[From] = NoNode;
+
+    if ( NodeId == NoNode ) return;
+
+    if ( NodeId == Dropped ) {
+        dropBody( To, Twins[From] );
+        return;
+    }
+
+    Nodes[NodeId].BodyId = static_cast< int >( To );
+    setBodyNode( To, NodeId );
+}
+
+bool Quadtree::contains( const Vector2& Pos ) const {
+    if ( Nodes.empty() ) return false;
+
+    const auto& RootNode = Nodes[Root];
+
+    const float HalfSize = RootNode.Size * 0.5f;
+
+    return Pos.x >= RootNode.Center.x - HalfSize &&
+           Pos.x <= RootNode.Center.x + HalfSize &&
+           Pos.y >= RootNode.Center.y - HalfSize &&
+           Pos.y <= RootNode.Center.y + HalfSize;
+}
+
+void Quadtree::setBodyNode( const size_t Index, const unsigned NodeId ) {
+    if ( Index >= BodyNodes.size() ) BodyNodes.resize( Index + 1, NoNode );
+
+    BodyNodes[Index] = NodeId;
+}
+
 unsigned Quadtree::subdivide( unsigned NodeId ) {
-    Parents.push_back( NodeId );
-    unsigned ChildrenId = static_cast< unsigned >( Nodes.size() );
-    Nodes[NodeId]->Children = ChildrenId;
+    const unsigned ChildrenId = Nodes.getBlock( 4 );
+
+    if ( Parents.size() < Nodes.size() ) Parents.resize( Nodes.size(), NoNode );
+
+    Nodes[NodeId].Children = ChildrenId;
+    Revision += 1;
 
     for ( unsigned i = 1; i < 5; ++i ) {
-        Nodes.push_back( std::move( Mb->get() ) );
-        Nodes.back()->subdivide( Nodes[NodeId].get(), i - 1 );
+        Quad& Child = Nodes[ChildrenId + i - 1];
+        Child.init();
+        Child.subdivide( &Nodes[NodeId], i - 1 );
         if ( i == 4 )
-            Nodes.back()->Next = Nodes[NodeId]->Next;
+            Child.Next = Nodes[NodeId].Next;
         else
-            Nodes.back()->Next = ChildrenId + i;
+            Child.Next = ChildrenId + i;
+
+        Parents[ChildrenId + i - 1] = NodeId;
     }
 
     return ChildrenId;
 }
 
 void Quadtree::clear() {
-    for ( auto& Node : Nodes ) {
-        Mb->store( std::move( Node ) );
-    }
-    Nodes.clear();
+    Nodes.reset();
+    Aggregates.clear();
 
     Parents.clear();
+    BodyNodes.clear();
+    Twins.clear();
+
+    ParentsValid = true;
+
+    Revision += 1;
+}
+
+void Quadtree::computeAggregates( const BoidStore& Store ) {
+    Aggregates.resize( Nodes.size() );
+
+    // Children come after their parent unless incremental updates reused a
+    // freed block, then fall back to a reversed pre-order walk
+    AggregateOrder.clear();
+
+    const bool Reused = Nodes.hasReusedBlocks();
+
+    if ( Reused ) {
+        unsigned NodeId = Root;
+
+        while ( true ) {
+            AggregateOrder.push_back( NodeId );
+
+            if ( Nodes[NodeId].hasChildren() ) {
+                NodeId = Nodes[NodeId].Children;
+            } else {
+                if ( Nodes[NodeId].Next == 0 ) break;
+                NodeId = Nodes[NodeId].Next;
+            }
+        }
+    }
+
+    const size_t Count = Reused ? AggregateOrder.size() : Nodes.size();
+
+    for ( size_t n = Count; n-- > 0; ) {
+        const size_t i = Reused ? AggregateOrder[n] : n;
+
+        const Quad& Node = Nodes[i];
+        QuadAggregate& Aggregate = Aggregates[i];
+
+        Aggregate = QuadAggregate();
+
+        if ( Node.hasChildren() ) {
+            for ( unsigned c = Node.Children; c < Node.Children + 4; ++c ) {
+                const QuadAggregate& Child = Aggregates[c];
+
+                Aggregate.SumPosition =
+                    Vector2Add( Aggregate.SumPosition, Child.SumPosition );
+                Aggregate.SumVelocity =
+                    Vector2Add( Aggregate.SumVelocity, Child.SumVelocity );
+                Aggregate.Count += Child.Count;
+            }
+        } else if ( !Node.isEmpty() ) {
+            const size_t Body = static_cast< size_t >( Node.BodyId );
+
+            Aggregate.SumPosition = Store.getPosition( Body );
+            Aggregate.SumVelocity = Store.getVelocity( Body );
+            Aggregate.Count = 1;
+        }
+    }
+}
+
+void Quadtree::setTheta( const float Theta_ ) {
+    Theta = Theta_;
+    SquareTheta = Theta * Theta;
+}
+
+BoidsUpdateValues Quadtree::calculateVelocity( const BoidStore& Store,
+                                               const size_t Index,
+                                               const float LocalSize ) {
+    BoidsUpdateValues Values;
+
+    const Vector2 Position = Store.getPosition( Index );
+    const float LocalSizeSqr = LocalSize * LocalSize;
+    const float AvoidDistance = LocalSize * 0.4f;
+
+    size_t NodeId = Root;
+
+    while ( true ) {
+        const auto& Node = Nodes[NodeId];
+        const auto& Aggregate = Aggregates[NodeId];
+
+        // Distance from Position to the node's square
+        const float HalfSize = Node.Size * 0.5f;
+        const float Dx =
+            std::max( std::fabs( Position.x - Node.Center.x ) - HalfSize, 0.f );
+        const float Dy =
+            std::max( std::fabs( Position.y - Node.Center.y ) - HalfSize, 0.f );
+
+        bool Descend = false;
+
+        if ( Aggregate.Count == 0 || Dx * Dx + Dy * Dy >= LocalSizeSqr ) {
+            // Nothing in this node can be a neighbour
+        } else if ( !Node.hasChildren() ) {
+            const size_t Other = static_cast< size_t >( Node.BodyId );
+            const Vector2 OtherPosition = Store.getPosition( Other );
+
+            const float Distance = Vector2Distance( Position, OtherPosition );
+
+            if ( Other != Index && Distance < LocalSize ) {
+                Values.add( Position, OtherPosition, Store.getVelocity( Other ),
+                            Distance, AvoidDistance );
+            }
+        } else {
+            const Vector2 CenterOfMass = Vector2Scale(
+                Aggregate.SumPosition, 1.f / Aggregate.Count );
+
+            const float DistanceSqr =
+                Vector2DistanceSqr( Position, CenterOfMass );
+
+            // A node holding the boid itself would count it as its own
+            // neighbour, however far its center of mass is
+            if ( !Node.containsPoint( Position ) &&
+                 ( Node.Size * Node.Size ) < DistanceSqr * SquareTheta ) {
+                // Far enough away to treat the whole node as one heavy boid
+                // sitting at its center of mass
+                const float Distance = std::sqrt( DistanceSqr );
+
+                if ( Distance < LocalSize ) {
+                    BoidsUpdateValues Approximation;
+                    Approximation.add( Position, CenterOfMass, Vector2Zero(),
+                                       Distance, AvoidDistance );
+
+                    Values.Count += Aggregate.Count;
+                    Values.AvgVelocity =
+                        Vector2Add( Values.AvgVelocity, Aggregate.SumVelocity );
+                    Values.AvgPosition =
+                        Vector2Add( Values.AvgPosition, Aggregate.SumPosition );
+                    const float Weight =
+                        static_cast< float >( Aggregate.Count );
+                    Values.AvgAvoid = Vector2Add(
+                        Values.AvgAvoid,
+                        Vector2Scale( Approximation.AvgAvoid, Weight ) );
+                }
+            } else {
+                Descend = true;
+            }
+        }
+
+        if ( Descend ) {
+            NodeId = Node.Children;
+        } else {
+            if ( Node.Next == 0 ) break;
+
+            NodeId = Node.Next;
+        }
+    }
+
+    return Values;
+}
+
+const std::vector< Quad >& Quadtree::getNodes() const {
+    return Nodes.getNodes();
 }
 
-const std::vector< std::unique_ptr< Quad > >& Quadtree::getNodes() {
-    return Nodes;
+size_t Quadtree::countNodes( unsigned& Depth ) const {
+    Depth = 0;
+    if ( Nodes.empty() ) return 0;
+
+    return countNodes( Root, 0, Depth );
+}
+
+size_t Quadtree::countNodes( const unsigned NodeId, const unsigned Level,
+                             unsigned& Depth ) const {
+    Depth = std::max( Depth, Level );
+
+    const Quad& Node = Nodes[NodeId];
+    if ( !Node.hasChildren() ) return 1;
+
+    size_t Count = 1;
+    for ( unsigned c = Node.Children; c < Node.Children + 4; ++c ) {
+        Count += countNodes( c, Level + 1, Depth );
+    }
+
+    return Count;
 }
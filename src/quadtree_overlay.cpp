@@ -0,0 +1,223 @@
+
+#include <algorithm>
+#include <utility>
+
+#include "quadtree_overlay.hpp"
+
+#include "raymath.h"
+#include "rlgl.h"
+
+#include <fmt/core.h>
+#include "trace.hpp"
+#include "zone_profiler.hpp"
+
+namespace {
+
+#if defined( __EMSCRIPTEN__ )
+const char* VertexShaderCode = R"(#version 100
+attribute vec2 linePosition;
+uniform mat4 mvp;
+void main() { gl_Position = mvp * vec4( linePosition, 0.0, 1.0 ); }
+)";
+
+const char* FragmentShaderCode = R"(#version 100
+precision mediump float;
+uniform vec4 lineColor;
+void main() { gl_FragColor = lineColor; }
+)";
+#else
+const char* VertexShaderCode = R"(#version 330
+in vec2 linePosition;
+uniform mat4 mvp;
+void main() { gl_Position = mvp * vec4( linePosition, 0.0, 1.0 ); }
+)";
+
+const char* FragmentShaderCode = R"(#version 330
+uniform vec4 lineColor;
+out vec4 finalColor;
+void main() { finalColor = lineColor; }
+)";
+#endif
+
+} // namespace
+
+QuadtreeOverlay::QuadtreeOverlay() {
+    Shader = rlLoadShaderCode( VertexShaderCode, FragmentShaderCode );
+    // raylib hands back its default shader when compiling fails
+    if ( Shader == rlGetShaderIdDefault() ) Shader = 0;
+
+    Vao = rlLoadVertexArray();
+
+    if ( !isReady() ) {
+        Trace::message( "QuadtreeOverlay: vertex arrays unavailable, drawing "
+                        "through the raylib batch" );
+        return;
+    }
+
+    MvpLocation = rlGetLocationUniform( Shader, "mvp" );
+    ColorLocation = rlGetLocationUniform( Shader, "lineColor" );
+    PositionLocation = rlGetLocationAttrib( Shader, "linePosition" );
+}
+
+QuadtreeOverlay::~QuadtreeOverlay() {
+    if ( Vbo != 0 ) rlUnloadVertexBuffer( Vbo );
+    if ( Vao != 0 ) rlUnloadVertexArray( Vao );
+    if ( Shader != 0 ) rlUnloadShaderProgram( Shader );
+}
+
+void QuadtreeOverlay::stepMaxDepth( const int Delta ) {
+    const int Current =
+        static_cast< int >( std::min( MaxDepth, TreeDepth ) ) + Delta;
+
+    MaxDepth = Current >= static_cast< int >( TreeDepth )
+                   ? AllDepths
+                   : static_cast< unsigned >( std::max( Current, 0 ) );
+}
+
+void QuadtreeOverlay::draw( const Quadtree& Tree ) {
+    draw( Tree.getNodes(), Tree.getRevision() );
+}
+
+void QuadtreeOverlay::draw( const std::vector< Quad >& Nodes,
+                            const size_t Revision ) {
+    if ( !Enabled || Nodes.empty() ) return;
+
+    BOIDS_ZONE( "Draw quadtree" );
+
+    if ( !HasCache || CachedRevision != Revision || CachedDepth != MaxDepth ) {
+        rebuild( Nodes );
+        if ( isReady() ) upload();
+
+        HasCache = true;
+        CachedRevision = Revision;
+        CachedDepth = MaxDepth;
+    }
+
+    if ( !isReady() ) {
+        for ( size_t i = 0; i + 1 < Lines.size(); i += 2 ) {
+            DrawLineEx( Lines[i], Lines[i + 1], LineWidth, LineColor );
+        }
+        return;
+    }
+
+    if ( Vertices.empty() ) return;
+
+    rlDrawRenderBatchActive();
+
+    const Matrix Mvp =
+        MatrixMultiply( rlGetMatrixModelview(), rlGetMatrixProjection() );
+    const Vector4 Tint = ColorNormalize( LineColor );
+
+    rlDisableBackfaceCulling();
+    rlEnableShader( Shader );
+    rlSetUniformMatrix( MvpLocation, Mvp );
+    rlSetUniform( ColorLocation, &Tint, RL_SHADER_UNIFORM_VEC4, 1 );
+
+    rlEnableVertexArray( Vao );
+    rlDrawVertexArray( 0, static_cast< int >( Vertices.size() ) );
+    rlDisableVertexArray();
+
+    rlDisableShader();
+    rlEnableBackfaceCulling();
+}
+
+// Every node edge is either on the root boundary or on the cross that split
+// its parent, so each internal node only adds its cross
+void QuadtreeOverlay::rebuild( const std::vector< Quad >& Nodes ) {
+    Lines.clear();
+    TreeDepth = 0;
+
+    const Quad& RootNode = Nodes.front();
+    const float RootHalf = RootNode.Size * 0.5f;
+
+    const Vector2 Min = Vector2SubtractValue( RootNode.Center, RootHalf );
+    const Vector2 Max = Vector2AddValue( RootNode.Center, RootHalf );
+
+    addLine( Min, Vector2{ Max.x, Min.y } );
+    addLine( Vector2{ Max.x, Min.y }, Max );
+    addLine( Max, Vector2{ Min.x, Max.y } );
+    addLine( Vector2{ Min.x, Max.y }, Min );
+
+    std::vector< std::pair< unsigned, unsigned > > Stack;
+    Stack.emplace_back( 0, 0 );
+
+    while ( !Stack.empty() ) {
+        const auto [NodeId, Depth] = Stack.back();
+        Stack.pop_back();
+
+        const Quad& Node = Nodes[NodeId];
+        if ( !Node.hasChildren() ) continue;
+
+        TreeDepth = std::max( TreeDepth, Depth + 1 );
+
+        if ( Depth < MaxDepth ) {
+            const float Half = Node.Size * 0.5f;
+
+            addLine( Vector2{ Node.Center.x, Node.Center.y - Half },
+                     Vector2{ Node.Center.x, Node.Center.y + Half } );
+            addLine( Vector2{ Node.Center.x - Half, Node.Center.y },
+                     Vector2{ Node.Center.x + Half, Node.Center.y } );
+        }
+
+        for ( unsigned c = Node.Children; c < Node.Children + 4; ++c ) {
+            Stack.emplace_back( c, Depth + 1 );
+        }
+    }
+
+    // Widen the axis aligned lines into quads
+    Vertices.clear();
+    Vertices.reserve( Lines.size() * 3 );
+
+    const float Half = LineWidth * 0.5f;
+
+    for ( size_t i = 0; i + 1 < Lines.size(); i += 2 ) {
+        const Vector2 From = Lines[i];
+        const Vector2 To = Lines[i + 1];
+
+        const float X0 = std::min( From.x, To.x ) - Half;
+        const float X1 = std::max( From.x, To.x ) + Half;
+        const float Y0 = std::min( From.y, To.y ) - Half;
+        const float Y1 = std::max( From.y, To.y ) + Half;
+
+        Vertices.push_back( Vector2{ X0, Y0 } );
+        Vertices.push_back( Vector2{ X0, Y1 } );
+        Vertices.push_back( Vector2{ X1, Y1 } );
+
+        Vertices.push_back( Vector2{ X0, Y0 } );
+        Vertices.push_back( Vector2{ X1, Y1 } );
+        Vertices.push_back( Vector2{ X1, Y0 } );
+    }
+}
+
+void QuadtreeOverlay::upload() {
+    if ( Vertices.empty() ) return;
+
+    const int Size = static_cast< int >( Vertices.size() * sizeof( Vector2 ) );
+
+    if ( Vertices.size() <= Capacity ) {
+        rlUpdateVertexBuffer( Vbo, Vertices.data(), Size, 0 );
+        return;
+    }
+
+    Capacity = std::max( Vertices.size(), Capacity * 2 );
+
+    rlEnableVertexArray( Vao );
+
+    if ( Vbo != 0 ) rlUnloadVertexBuffer( Vbo );
+    Vbo = rlLoadVertexBuffer(
+        nullptr, static_cast< int >( Capacity * sizeof( Vector2 ) ), true );
+    rlUpdateVertexBuffer( Vbo, Vertices.data(), Size, 0 );
+
+    if ( PositionLocation >= 0 ) {
+        rlSetVertexAttribute( PositionLocation, 2, RL_FLOAT, false, 0,
+                              nullptr );
+        rlEnableVertexAttribute( PositionLocation );
+    }
+
+    rlDisableVertexArray();
+}
+
+void QuadtreeOverlay::addLine( const Vector2& From, const Vector2& To ) {
+    Lines.push_back( From );
+    Lines.push_back( To );
+}
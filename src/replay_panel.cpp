@@ -0,0 +1,70 @@
+
+#include <algorithm>
+
+#include "replay_panel.hpp"
+
+#include "imgui.h"
+
+#include <fmt/core.h>
+
+ReplayPanel::ReplayPanel( TrajectoryReplay& Replay_ ) : Replay( Replay_ ) {
+    seek( 0 );
+}
+
+void ReplayPanel::update() {
+    if ( !Playing ) return;
+
+    const int Last = static_cast< int >( Replay.getFrameCount() ) - 1;
+
+    if ( Frame < Last )
+        seek( Frame + 1 );
+    else if ( Loop )
+        seek( 0 );
+    else
+        Playing = false;
+}
+
+void ReplayPanel::step( const int Delta ) {
+    Playing = false;
+    seek( Frame + Delta );
+}
+
+void ReplayPanel::display() {
+    if ( !ImGui::Begin( "Replay" ) ) {
+        ImGui::End();
+        return;
+    }
+
+    const int Last = static_cast< int >( Replay.getFrameCount() ) - 1;
+
+    ImGui::TextUnformatted(
+        fmt::format( "Tick {}, {} boids",
+                     Replay.getTick( static_cast< size_t >( Frame ) ),
+                     Replay.getStore().size() )
+            .c_str() );
+
+    if ( ImGui::Button( Playing ? "Pause" : "Play" ) ) togglePlaying();
+    ImGui::SameLine();
+    if ( ImGui::Button( "<" ) ) step( -1 );
+    ImGui::SameLine();
+    if ( ImGui::Button( ">" ) ) step( 1 );
+    ImGui::SameLine();
+    ImGui::Checkbox( "Loop", &Loop );
+
+    int Target = Frame;
+    if ( ImGui::SliderInt( "Frame", &Target, 0, std::max( Last, 0 ) ) )
+        seek( Target );
+
+    ImGui::End();
+}
+
+void ReplayPanel::seek( const int Frame_ ) {
+    const int Last = static_cast< int >( Replay.getFrameCount() ) - 1;
+    const int Target = std::clamp( Frame_, 0, std::max( Last, 0 ) );
+
+    // A corrupt chunk stops playback where it is
+    if ( Replay.seek( static_cast< size_t >( Target ) ) )
+        Frame = Target;
+    else
+        Playing = false;
+}
@@ -0,0 +1,146 @@
+
+#include <algorithm>
+
+#include "simulation_thread.hpp"
+
+#include <fmt/core.h>
+#include "trace.hpp"
+#include "zone_profiler.hpp"
+
+SimulationThread::SimulationThread( BoidManager& Manager_,
+                                    const double TickRate )
+    : Manager( Manager_ ),
+      Period( std::chrono::duration_cast< std::chrono::nanoseconds >(
+          std::chrono::duration< double >( 1.0 / TickRate ) ) ) {}
+
+SimulationThread::~SimulationThread() { stop(); }
+
+void SimulationThread::start() {
+    if ( isRunning() ) return;
+
+    Running.store( true, std::memory_order_release );
+    Worker = std::thread( &SimulationThread::run, this );
+}
+
+void SimulationThread::stop() {
+    if ( !isRunning() ) return;
+
+    Running.store( false, std::memory_order_release );
+    Worker.join();
+
+    // Anything posted after the last tick still has to happen
+    runCommands();
+}
+
+void SimulationThread::post( std::function< void( BoidManager& ) > Command ) {
+    if ( !isRunning() ) {
+        Command( Manager );
+        return;
+    }
+
+    std::lock_guard< std::mutex > Lock( CommandMutex );
+    Commands.push_back( std::move( Command ) );
+}
+
+void SimulationThread::setUpdate( const UpdateFunction Update_ ) {
+    if ( !isRunning() ) {
+        Update = Update_;
+        return;
+    }
+
+    post( [this, Update_]( BoidManager& ) { Update = Update_; } );
+}
+
+void SimulationThread::setRecorder( TrajectoryRecorder* Recorder_ ) {
+    if ( !isRunning() ) {
+        Recorder = Recorder_;
+        return;
+    }
+
+    post( [this, Recorder_]( BoidManager& ) { Recorder = Recorder_; } );
+}
+
+const FlockSnapshot* SimulationThread::acquire() {
+    if ( Snapshots.acquire() ) HasSnapshot = true;
+
+    return HasSnapshot ? &Snapshots.getReadBuffer() : nullptr;
+}
+
+float SimulationThread::getInterpolation(
+    const FlockSnapshot& Snapshot ) const {
+    const auto Elapsed = std::chrono::steady_clock::now() - Snapshot.Time;
+
+    const float Alpha = static_cast< float >(
+        std::chrono::duration< double >( Elapsed ).count() /
+        std::chrono::duration< double >( Period ).count() );
+
+    return std::clamp( Alpha, 0.f, 1.f );
+}
+
+void SimulationThread::run() {
+    BOIDS_ZONE_THREAD( "Simulation" );
+
+    auto Next = std::chrono::steady_clock::now();
+    bool Behind = false;
+
+    while ( Running.load( std::memory_order_acquire ) ) {
+        runCommands();
+
+        ( Manager.*Update )();
+        publish();
+
+        if ( Recorder != nullptr )
+            Recorder->record( Manager.getStore(), Manager.getTickStats().Tick );
+
+        Next += Period;
+
+        // Don't try to catch up after a long stall, just drop the ticks.
+        // Only the first drop of a streak is reported.
+        const auto Now = std::chrono::steady_clock::now();
+        if ( Now - Next > Period * 4 ) {
+            if ( !Behind ) {
+                Trace::message( fmt::format(
+                    "{:>24}: {:.2f} ms behind, dropping ticks", "Simulation",
+                    std::chrono::duration< double, std::milli >( Now - Next )
+                        .count() ) );
+            }
+
+            Behind = true;
+            Next = Now;
+        } else if ( Now <= Next ) {
+            Behind = false;
+        }
+
+        std::this_thread::sleep_until( Next );
+    }
+}
+
+void SimulationThread::runCommands() {
+    {
+        std::lock_guard< std::mutex > Lock( CommandMutex );
+        PendingCommands.swap( Commands );
+    }
+
+    for ( auto& Command : PendingCommands ) {
+        Command( Manager );
+    }
+
+    PendingCommands.clear();
+}
+
+void SimulationThread::publish() {
+    BOIDS_ZONE( "Publish snapshot" );
+
+    FlockSnapshot& Snapshot = Snapshots.getWriteBuffer();
+
+    // Copy assignment keeps the buffers' capacity from earlier ticks
+    Snapshot.Store = Manager.getStore();
+    Snapshot.Nodes = Manager.getQuadtree()->getNodes();
+    Snapshot.TreeRevision = Manager.getQuadtree()->getRevision();
+    Snapshot.Stats = Manager.getTickStats();
+
+    Snapshot.Tick = ++Ticks;
+    Snapshot.Time = std::chrono::steady_clock::now();
+
+    Snapshots.publish();
+}
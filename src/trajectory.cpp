@@ -0,0 +1,310 @@
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "trajectory.hpp"
+
+namespace Trajectory {
+
+namespace {
+
+// Worst case for a 32 bit varint
+constexpr size_t MaxVarintSize = 5;
+
+// Wrapping arithmetic, a boid crossing half the int32 range just costs bytes
+int32_t wrapSub( const int32_t A, const int32_t B ) {
+    return static_cast< int32_t >( static_cast< uint32_t >( A ) -
+                                   static_cast< uint32_t >( B ) );
+}
+
+int32_t wrapAdd( const int32_t A, const int32_t B ) {
+    return static_cast< int32_t >( static_cast< uint32_t >( A ) +
+                                   static_cast< uint32_t >( B ) );
+}
+
+uint32_t zigzag( const int32_t Value ) {
+    return ( static_cast< uint32_t >( Value ) << 1 ) ^
+           static_cast< uint32_t >( Value >> 31 );
+}
+
+int32_t unzigzag( const uint32_t Value ) {
+    return static_cast< int32_t >( ( Value >> 1 ) ^ ( 0u - ( Value & 1u ) ) );
+}
+
+uint8_t* putVarint( uint8_t* Out, uint32_t Value ) {
+    while ( Value >= 0x80 ) {
+        *Out++ = static_cast< uint8_t >( Value | 0x80 );
+        Value >>= 7;
+    }
+
+    *Out++ = static_cast< uint8_t >( Value );
+    return Out;
+}
+
+bool getVarint( const uint8_t*& In, const uint8_t* End, uint32_t& Value ) {
+    // Nearly every delta fits in one byte
+    if ( In != End && *In < 0x80 ) {
+        Value = *In++;
+        return true;
+    }
+
+    Value = 0;
+
+    for ( unsigned Shift = 0; Shift < 7 * MaxVarintSize; Shift += 7 ) {
+        if ( In == End ) return false;
+
+        const uint8_t Byte = *In++;
+        Value |= static_cast< uint32_t >( Byte & 0x7f ) << Shift;
+
+        if ( ( Byte & 0x80 ) == 0 ) return true;
+    }
+
+    return false;
+}
+
+// Where a boid's position moves in one tick at a velocity, Shift being
+// VelocityBits - PositionBits
+int32_t step( const int32_t Velocity, const uint32_t Shift ) {
+    if ( Shift == 0 ) return Velocity;
+
+    return wrapAdd( Velocity, 1 << ( Shift - 1 ) ) >> Shift;
+}
+
+// Scaling by a power of two is exact, only the rounding loses anything
+float getScale( const uint32_t Bits ) {
+    return static_cast< float >( 1u << Bits );
+}
+
+// Previous nullptr stores the values themselves
+uint8_t* encodeValues( uint8_t* Out, const int32_t* Current,
+                       const int32_t* Previous, const size_t Count ) {
+    for ( size_t i = 0; i < Count; ++i ) {
+        const int32_t Delta =
+            Previous != nullptr ? wrapSub( Current[i], Previous[i] )
+                                : Current[i];
+        Out = putVarint( Out, zigzag( Delta ) );
+    }
+
+    return Out;
+}
+
+uint8_t* encodePositions( uint8_t* Out, const int32_t* Current,
+                          const int32_t* Previous, const int32_t* Velocities,
+                          const size_t Count, const uint32_t Shift ) {
+    for ( size_t i = 0; i < Count; ++i ) {
+        const int32_t Predicted =
+            wrapAdd( Previous[i], step( Velocities[i], Shift ) );
+        Out = putVarint( Out, zigzag( wrapSub( Current[i], Predicted ) ) );
+    }
+
+    return Out;
+}
+
+// Keyframes store the values, other chunks add onto what Values holds
+template < bool Keyframe >
+bool decodeValues( const uint8_t*& In, const uint8_t* End, int32_t* Values,
+                   const size_t Count ) {
+    uint32_t Value = 0;
+
+    for ( size_t i = 0; i < Count; ++i ) {
+        if ( !getVarint( In, End, Value ) ) return false;
+
+        Values[i] = Keyframe ? unzigzag( Value )
+                             : wrapAdd( Values[i], unzigzag( Value ) );
+    }
+
+    return true;
+}
+
+bool decodePositions( const uint8_t*& In, const uint8_t* End,
+                      int32_t* Positions, const int32_t* Velocities,
+                      const size_t Count, const uint32_t Shift ) {
+    uint32_t Value = 0;
+
+    for ( size_t i = 0; i < Count; ++i ) {
+        if ( !getVarint( In, End, Value ) ) return false;
+
+        Positions[i] =
+            wrapAdd( wrapAdd( Positions[i], step( Velocities[i], Shift ) ),
+                     unzigzag( Value ) );
+    }
+
+    return true;
+}
+
+template < bool Keyframe >
+bool decodeSections( const uint8_t* In, const uint8_t* End,
+                     const size_t Begin, const size_t Count,
+                     const uint32_t Shift, QuantisedFrame& Frame ) {
+    int32_t* VelocityX = Frame.VelocityX.data() + Begin;
+    int32_t* VelocityY = Frame.VelocityY.data() + Begin;
+    int32_t* PositionX = Frame.PositionX.data() + Begin;
+    int32_t* PositionY = Frame.PositionY.data() + Begin;
+
+    // Velocities first, the position predictions need them
+    if ( !decodeValues< Keyframe >( In, End, VelocityX, Count ) ||
+         !decodeValues< Keyframe >( In, End, VelocityY, Count ) )
+        return false;
+
+    if ( Keyframe ) {
+        return decodeValues< true >( In, End, PositionX, Count ) &&
+               decodeValues< true >( In, End, PositionY, Count ) && In == End;
+    }
+
+    return decodePositions( In, End, PositionX, VelocityX, Count, Shift ) &&
+           decodePositions( In, End, PositionY, VelocityY, Count, Shift ) &&
+           In == End;
+}
+
+} // namespace
+
+void QuantisedFrame::resize( const size_t Count ) {
+    PositionX.resize( Count );
+    PositionY.resize( Count );
+    VelocityX.resize( Count );
+    VelocityY.resize( Count );
+}
+
+void quantise( const float* PositionX, const float* PositionY,
+               const float* VelocityX, const float* VelocityY,
+               const size_t Count, const Header& Format,
+               QuantisedFrame& Frame ) {
+    Frame.resize( Count );
+
+    const float PositionScale = getScale( Format.PositionBits );
+    const float VelocityScale = getScale( Format.VelocityBits );
+
+    const auto toFixed = []( const float Value, const float Scale ) {
+        return static_cast< int32_t >( std::nearbyint( Value * Scale ) );
+    };
+
+    for ( size_t i = 0; i < Count; ++i ) {
+        Frame.PositionX[i] = toFixed( PositionX[i], PositionScale );
+        Frame.PositionY[i] = toFixed( PositionY[i], PositionScale );
+        Frame.VelocityX[i] = toFixed( VelocityX[i], VelocityScale );
+        Frame.VelocityY[i] = toFixed( VelocityY[i], VelocityScale );
+    }
+}
+
+void dequantise( const QuantisedFrame& Frame, const Header& Format,
+                 const size_t Begin, const size_t End, float* PositionX,
+                 float* PositionY, float* VelocityX, float* VelocityY ) {
+    const float PositionScale = 1.f / getScale( Format.PositionBits );
+    const float VelocityScale = 1.f / getScale( Format.VelocityBits );
+
+    const auto fromFixed = []( const int32_t Value, const float Scale ) {
+        return static_cast< float >( Value ) * Scale;
+    };
+
+    for ( size_t i = Begin; i < End; ++i ) {
+        PositionX[i] = fromFixed( Frame.PositionX[i], PositionScale );
+        PositionY[i] = fromFixed( Frame.PositionY[i], PositionScale );
+        VelocityX[i] = fromFixed( Frame.VelocityX[i], VelocityScale );
+        VelocityY[i] = fromFixed( Frame.VelocityY[i], VelocityScale );
+    }
+}
+
+void encode( const QuantisedFrame& Current, const QuantisedFrame* Previous,
+             const Header& Format, std::vector< uint8_t >& Payload ) {
+    const size_t Count = Current.size();
+    const size_t Blocks = getBlockCount( Count );
+    const size_t Table = Payload.size();
+    const size_t TableBytes = Blocks * sizeof( uint32_t );
+    const uint32_t Shift = Format.VelocityBits - Format.PositionBits;
+
+    Payload.resize( Table + TableBytes + Count * 4 * MaxVarintSize );
+    uint8_t* Out = Payload.data() + Table + TableBytes;
+
+    for ( size_t b = 0; b < Blocks; ++b ) {
+        const size_t Begin = b * BlockSize;
+        const size_t Length = std::min( BlockSize, Count - Begin );
+        const uint8_t* const Start = Out;
+
+        if ( Previous == nullptr ) {
+            Out = encodeValues( Out, Current.VelocityX.data() + Begin, nullptr,
+                                Length );
+            Out = encodeValues( Out, Current.VelocityY.data() + Begin, nullptr,
+                                Length );
+            Out = encodeValues( Out, Current.PositionX.data() + Begin, nullptr,
+                                Length );
+            Out = encodeValues( Out, Current.PositionY.data() + Begin, nullptr,
+                                Length );
+        } else {
+            Out = encodeValues( Out, Current.VelocityX.data() + Begin,
+                                Previous->VelocityX.data() + Begin, Length );
+            Out = encodeValues( Out, Current.VelocityY.data() + Begin,
+                                Previous->VelocityY.data() + Begin, Length );
+            Out = encodePositions( Out, Current.PositionX.data() + Begin,
+                                   Previous->PositionX.data() + Begin,
+                                   Current.VelocityX.data() + Begin, Length,
+                                   Shift );
+            Out = encodePositions( Out, Current.PositionY.data() + Begin,
+                                   Previous->PositionY.data() + Begin,
+                                   Current.VelocityY.data() + Begin, Length,
+                                   Shift );
+        }
+
+        const uint32_t Size = static_cast< uint32_t >( Out - Start );
+        std::memcpy( Payload.data() + Table + b * sizeof( uint32_t ), &Size,
+                     sizeof( Size ) );
+    }
+
+    Payload.resize( static_cast< size_t >( Out - Payload.data() ) );
+}
+
+bool readBlocks( const uint8_t* Payload, const size_t Size,
+                 const size_t Count, std::vector< size_t >& Offsets ) {
+    const size_t Blocks = getBlockCount( Count );
+    const size_t TableBytes = Blocks * sizeof( uint32_t );
+    if ( Size < TableBytes ) return false;
+
+    Offsets.resize( Blocks + 1 );
+    Offsets[0] = TableBytes;
+
+    for ( size_t b = 0; b < Blocks; ++b ) {
+        uint32_t BlockBytes = 0;
+        std::memcpy( &BlockBytes, Payload + b * sizeof( uint32_t ),
+                     sizeof( BlockBytes ) );
+
+        if ( BlockBytes > Size - Offsets[b] ) return false;
+        Offsets[b + 1] = Offsets[b] + BlockBytes;
+    }
+
+    return Offsets.back() == Size;
+}
+
+bool decodeBlock( const uint8_t* Payload, const std::vector< size_t >& Offsets,
+                  const size_t Block, const bool Keyframe,
+                  const Header& Format, QuantisedFrame& Frame ) {
+    const size_t Begin = Block * BlockSize;
+    const size_t Length = std::min( BlockSize, Frame.size() - Begin );
+    const uint8_t* In = Payload + Offsets[Block];
+    const uint8_t* End = Payload + Offsets[Block + 1];
+    const uint32_t Shift = Format.VelocityBits - Format.PositionBits;
+
+    if ( Keyframe )
+        return decodeSections< true >( In, End, Begin, Length, Shift, Frame );
+
+    return decodeSections< false >( In, End, Begin, Length, Shift, Frame );
+}
+
+bool decode( const uint8_t* Payload, const size_t Size, const size_t Count,
+             const bool Keyframe, const Header& Format,
+             QuantisedFrame& Frame ) {
+    if ( !Keyframe && Frame.size() != Count ) return false;
+
+    std::vector< size_t > Offsets;
+    if ( !readBlocks( Payload, Size, Count, Offsets ) ) return false;
+
+    Frame.resize( Count );
+
+    for ( size_t b = 0; b + 1 < Offsets.size(); ++b ) {
+        if ( !decodeBlock( Payload, Offsets, b, Keyframe, Format, Frame ) )
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace Trajectory
@@ -0,0 +1,227 @@
+
+#include <algorithm>
+#include <numeric>
+
+#include "trajectory_recorder.hpp"
+
+#include <fmt/core.h>
+#include "trace.hpp"
+#include "zone_profiler.hpp"
+
+namespace {
+
+// 1/64 px and 1/256 px per tick, well below what a boid moves in a frame
+constexpr uint32_t PositionBits = 6;
+constexpr uint32_t VelocityBits = 8;
+
+} // namespace
+
+TrajectoryRecorder::TrajectoryRecorder( const size_t BufferCount )
+    : Buffers( std::max< size_t >( BufferCount, 2 ) ) {
+    FreeBuffers.reserve( Buffers.size() );
+    Queue.resize( Buffers.size() );
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() { stop(); }
+
+bool TrajectoryRecorder::start( const std::string& Path_, const Vector2& Bounds,
+                                const uint32_t KeyframeInterval ) {
+    if ( isRecording() ) return false;
+
+    File.open( Path_, std::ios::binary | std::ios::trunc );
+    if ( !File ) {
+        Trace::message( fmt::format( "{:>24}: could not open {}",
+                                     "Trajectory", Path_ ) );
+        return false;
+    }
+
+    Path = Path_;
+    Failed = false;
+    Offset = 0;
+    HasPrevious = false;
+    LastKeyframe = 0;
+    Index.clear();
+
+    Frames.store( 0 );
+    Dropped.store( 0 );
+    Bytes.store( 0 );
+
+    Format = Trajectory::Header{};
+    Format.Magic = Trajectory::Magic;
+    Format.Version = Trajectory::Version;
+    Format.HeaderSize = sizeof( Trajectory::Header );
+    Format.BoundsX = Bounds.x;
+    Format.BoundsY = Bounds.y;
+    Format.PositionBits = PositionBits;
+    Format.VelocityBits = VelocityBits;
+    Format.KeyframeInterval = std::max( KeyframeInterval, 1u );
+
+    write( &Format, sizeof( Format ) );
+
+    {
+        std::lock_guard< std::mutex > Lock( Mutex );
+
+        FreeBuffers.resize( Buffers.size() );
+        std::iota( FreeBuffers.begin(), FreeBuffers.end(), size_t{ 0 } );
+        QueueHead = 0;
+        QueueSize = 0;
+        Stopping = false;
+    }
+
+    Writer = std::thread( &TrajectoryRecorder::run, this );
+    Recording.store( true, std::memory_order_release );
+
+    return true;
+}
+
+void TrajectoryRecorder::stop() {
+    if ( !isRecording() ) return;
+
+    {
+        // A record() between taking a buffer and queueing it would be lost,
+        // or finish into the next recording's buffers after a start()
+        std::unique_lock< std::mutex > Lock( Mutex );
+        Settled.wait( Lock, [this]() { return InFlight == 0; } );
+        Stopping = true;
+    }
+
+    Wake.notify_one();
+    Writer.join();
+
+    writeIndex();
+    File.close();
+
+    Recording.store( false, std::memory_order_release );
+
+    Trace::message( fmt::format(
+        "{:>24}: {} ticks, {:.1f} MB to {}, {} dropped", "Trajectory",
+        Frames.load(), static_cast< double >( Bytes.load() ) / 1e6, Path,
+        Dropped.load() ) );
+}
+
+bool TrajectoryRecorder::record( const BoidStore& Store, const uint64_t Tick ) {
+    if ( !Recording.load( std::memory_order_acquire ) ) return false;
+
+    BOIDS_ZONE( "Record trajectory" );
+
+    size_t Slot = 0;
+
+    {
+        std::lock_guard< std::mutex > Lock( Mutex );
+
+        if ( Stopping ) return false;
+
+        if ( FreeBuffers.empty() ) {
+            Dropped.fetch_add( 1, std::memory_order_relaxed );
+            return false;
+        }
+
+        Slot = FreeBuffers.back();
+        FreeBuffers.pop_back();
+        InFlight += 1;
+    }
+
+    // Assign keeps the capacity from earlier ticks
+    Buffer& Frame = Buffers[Slot];
+    Frame.Tick = Tick;
+    Frame.PositionX.assign( Store.PositionX.begin(), Store.PositionX.end() );
+    Frame.PositionY.assign( Store.PositionY.begin(), Store.PositionY.end() );
+    Frame.VelocityX.assign( Store.VelocityX.begin(), Store.VelocityX.end() );
+    Frame.VelocityY.assign( Store.VelocityY.begin(), Store.VelocityY.end() );
+
+    // Notified under the lock, stop() may tear down as soon as it is released
+    std::lock_guard< std::mutex > Lock( Mutex );
+
+    Queue[( QueueHead + QueueSize ) % Queue.size()] = Slot;
+    QueueSize += 1;
+    InFlight -= 1;
+
+    Wake.notify_one();
+    if ( InFlight == 0 ) Settled.notify_all();
+
+    return true;
+}
+
+void TrajectoryRecorder::run() {
+    BOIDS_ZONE_THREAD( "Trajectory writer" );
+
+    while ( true ) {
+        size_t Slot = 0;
+
+        {
+            std::unique_lock< std::mutex > Lock( Mutex );
+            Wake.wait( Lock, [this]() { return QueueSize > 0 || Stopping; } );
+
+            if ( QueueSize == 0 ) return;
+
+            Slot = Queue[QueueHead];
+            QueueHead = ( QueueHead + 1 ) % Queue.size();
+            QueueSize -= 1;
+        }
+
+        writeFrame( Buffers[Slot] );
+        Frames.fetch_add( 1, std::memory_order_relaxed );
+
+        std::lock_guard< std::mutex > Lock( Mutex );
+        FreeBuffers.push_back( Slot );
+    }
+}
+
+void TrajectoryRecorder::writeFrame( const Buffer& Frame ) {
+    BOIDS_ZONE( "Encode trajectory" );
+
+    const size_t Count = Frame.PositionX.size();
+
+    Trajectory::quantise( Frame.PositionX.data(), Frame.PositionY.data(),
+                          Frame.VelocityX.data(), Frame.VelocityY.data(),
+                          Count, Format, Current );
+
+    // Deltas need the same boids in the same slots, spawning or despawning
+    // starts a new keyframe
+    const bool Keyframe =
+        !HasPrevious || Previous.size() != Count ||
+        Index.size() - LastKeyframe >= Format.KeyframeInterval;
+
+    Payload.clear();
+    Trajectory::encode( Current, Keyframe ? nullptr : &Previous, Format,
+                        Payload );
+
+    if ( Keyframe ) LastKeyframe = Index.size();
+    Index.push_back( Trajectory::IndexEntry{ Offset, LastKeyframe } );
+
+    const Trajectory::FrameHeader Chunk{
+        Frame.Tick, static_cast< uint32_t >( Count ),
+        Keyframe ? Trajectory::FF_Keyframe : 0u, Payload.size() };
+
+    write( &Chunk, sizeof( Chunk ) );
+    write( Payload.data(), Payload.size() );
+
+    std::swap( Previous, Current );
+    HasPrevious = true;
+}
+
+void TrajectoryRecorder::writeIndex() {
+    const Trajectory::Footer End{ Offset, Index.size(),
+                                  Trajectory::IndexMagic };
+
+    write( Index.data(), Index.size() * sizeof( Trajectory::IndexEntry ) );
+    write( &End, sizeof( End ) );
+}
+
+void TrajectoryRecorder::write( const void* Data, const size_t Size ) {
+    if ( Failed ) return;
+
+    File.write( static_cast< const char* >( Data ),
+                static_cast< std::streamsize >( Size ) );
+
+    if ( !File ) {
+        Failed = true;
+        Trace::message( fmt::format( "{:>24}: writing {} failed, stopped "
+                                     "saving frames",
+                                     "Trajectory", Path ) );
+        return;
+    }
+
+    Offset += Size;
+    Bytes.fetch_add( Size, std::memory_order_relaxed );
+}
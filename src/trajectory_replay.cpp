@@ -0,0 +1,275 @@
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+#include "trajectory_replay.hpp"
+
+#include <fmt/core.h>
+#include "trace.hpp"
+#include "zone_profiler.hpp"
+
+namespace {
+
+// Chunks are packed back to back, so anything read from the file is copied
+// out rather than dereferenced in place
+template < typename T >
+bool readAt( const MappedFile& File, const size_t Offset, T& Out ) {
+    const std::byte* Source = File.get< std::byte >( Offset, sizeof( T ) );
+    if ( Source == nullptr ) return false;
+
+    std::memcpy( &Out, Source, sizeof( T ) );
+    return true;
+}
+
+} // namespace
+
+bool TrajectoryReplay::open( const std::string& Path ) {
+    close();
+
+    if ( !Stp ) {
+        Stp = std::make_unique< StaticThreadPool >();
+        Stp->initialize( &TrajectoryReplay::decodeWorker, this );
+    }
+
+    if ( !File.open( Path ) ) {
+        Trace::message( fmt::format( "{:>24}: {}, could not map the file",
+                                     "Replay not opened", Path ) );
+        return false;
+    }
+
+    const bool Valid =
+        readAt( File, 0, Format ) && Format.Magic == Trajectory::Magic &&
+        Format.Version == Trajectory::Version &&
+        Format.HeaderSize >= sizeof( Trajectory::Header ) &&
+        Format.HeaderSize <= File.size() &&
+        Format.PositionBits <= Format.VelocityBits && Format.VelocityBits <= 24;
+
+    if ( !Valid ) {
+        Trace::message( fmt::format( "{:>24}: {}, not a trajectory",
+                                     "Replay not opened", Path ) );
+        close();
+        return false;
+    }
+
+    const bool Indexed = readIndex();
+    if ( !Indexed && !scanChunks() ) {
+        Trace::message( fmt::format( "{:>24}: {}, no complete ticks",
+                                     "Replay not opened", Path ) );
+        close();
+        return false;
+    }
+
+    Trace::message( fmt::format( "{:>24}: {} ticks from {}{}", "Replay opened",
+                                 Index.size(), Path,
+                                 Indexed ? "" : ", index rebuilt" ) );
+
+    return true;
+}
+
+void TrajectoryReplay::close() {
+    File.close();
+    Index.clear();
+    DataEnd = 0;
+    Current = NoFrame;
+    TreeFrame = NoFrame;
+}
+
+uint64_t TrajectoryReplay::getTick( const size_t Frame ) const {
+    Trajectory::FrameHeader Chunk;
+    const uint8_t* Payload = nullptr;
+
+    if ( Frame >= Index.size() ||
+         !readChunk( Index[Frame].Offset, Chunk, Payload ) )
+        return 0;
+
+    return Chunk.Tick;
+}
+
+Vector2 TrajectoryReplay::getBounds() const {
+    return Vector2{ Format.BoundsX, Format.BoundsY };
+}
+
+bool TrajectoryReplay::seek( const size_t Frame ) {
+    if ( Frame >= Index.size() ) return false;
+    if ( Frame == Current ) return true;
+
+    BOIDS_ZONE( "Replay seek" );
+
+    // Carry on from the current frame when it is on the way
+    size_t Start = Index[Frame].Keyframe;
+    if ( Current != NoFrame && Current < Frame && Current >= Start )
+        Start = Current + 1;
+
+    for ( size_t f = Start; f <= Frame; ++f ) {
+        if ( decodeFrame( f, f == Frame ) ) continue;
+
+        Trace::message( fmt::format( "{:>24}: tick {} is corrupt",
+                                     "Replay", f ) );
+        Current = NoFrame;
+        return false;
+    }
+
+    Current = Frame;
+
+    // Start paging in the next chunk while this one is drawn
+    if ( Frame + 1 < Index.size() ) {
+        const size_t Next = Index[Frame + 1].Offset;
+        File.prefetch( Next, getChunkEnd( Frame + 1 ) - Next );
+    }
+
+    return true;
+}
+
+const Quadtree& TrajectoryReplay::getQuadtree() {
+    if ( TreeFrame == Current ) return Tree;
+
+    BOIDS_ZONE( "Replay tree" );
+
+    if ( Store.size() > 0 )
+        Tree.build( Store );
+    else
+        Tree.clear();
+
+    TreeFrame = Current;
+    return Tree;
+}
+
+bool TrajectoryReplay::readIndex() {
+    Trajectory::Footer End;
+
+    if ( File.size() < Format.HeaderSize + sizeof( End ) ||
+         !readAt( File, File.size() - sizeof( End ), End ) ||
+         End.Magic != Trajectory::IndexMagic )
+        return false;
+
+    const size_t IndexSpace = File.size() - sizeof( End );
+    if ( End.IndexOffset < Format.HeaderSize || End.IndexOffset > IndexSpace )
+        return false;
+
+    const size_t IndexBytes = IndexSpace - End.IndexOffset;
+    if ( IndexBytes % sizeof( Trajectory::IndexEntry ) != 0 ||
+         End.FrameCount != IndexBytes / sizeof( Trajectory::IndexEntry ) )
+        return false;
+
+    Index.resize( End.FrameCount );
+    std::memcpy( Index.data(), File.data() + End.IndexOffset,
+                 Index.size() * sizeof( Trajectory::IndexEntry ) );
+
+    DataEnd = End.IndexOffset;
+
+    // Chunks have to be in file order and point back at a keyframe
+    for ( size_t f = 0; f < Index.size(); ++f ) {
+        const size_t Offset = Index[f].Offset;
+
+        if ( Offset < Format.HeaderSize || Offset >= DataEnd ||
+             ( f > 0 && Offset <= Index[f - 1].Offset ) ||
+             Index[f].Keyframe > f ) {
+            Index.clear();
+            return false;
+        }
+    }
+
+    return !Index.empty();
+}
+
+bool TrajectoryReplay::scanChunks() {
+    Index.clear();
+    DataEnd = File.size();
+
+    size_t Offset = Format.HeaderSize;
+    size_t Keyframe = NoFrame;
+
+    // Stops at the first chunk cut short, the rest of a crashed recording
+    Trajectory::FrameHeader Chunk;
+    const uint8_t* Payload = nullptr;
+
+    while ( readChunk( Offset, Chunk, Payload ) ) {
+        if ( Chunk.Flags & Trajectory::FF_Keyframe ) Keyframe = Index.size();
+        if ( Keyframe == NoFrame ) break;
+
+        Index.push_back( Trajectory::IndexEntry{ Offset, Keyframe } );
+        Offset += sizeof( Chunk ) + Chunk.PayloadSize;
+    }
+
+    DataEnd = Offset;
+
+    return !Index.empty();
+}
+
+bool TrajectoryReplay::readChunk( const size_t Offset,
+                                  Trajectory::FrameHeader& Chunk,
+                                  const uint8_t*& Payload ) const {
+    if ( Offset > DataEnd || DataEnd - Offset < sizeof( Chunk ) ||
+         !readAt( File, Offset, Chunk ) )
+        return false;
+
+    if ( Chunk.PayloadSize > DataEnd - Offset - sizeof( Chunk ) ) return false;
+
+    Payload = reinterpret_cast< const uint8_t* >( File.data() + Offset +
+                                                  sizeof( Chunk ) );
+    return true;
+}
+
+bool TrajectoryReplay::decodeFrame( const size_t Frame, const bool Last_ ) {
+    Trajectory::FrameHeader Chunk;
+
+    if ( !readChunk( Index[Frame].Offset, Chunk, ChunkData ) ||
+         !Trajectory::readBlocks( ChunkData, Chunk.PayloadSize, Chunk.Count,
+                                  Offsets ) )
+        return false;
+
+    Keyframe = ( Chunk.Flags & Trajectory::FF_Keyframe ) != 0;
+    if ( !Keyframe && Quantised.size() != Chunk.Count ) return false;
+
+    Quantised.resize( Chunk.Count );
+
+    // Only the frame being sought is converted for drawing
+    Last = Last_;
+    if ( Last && Store.size() != Chunk.Count ) {
+        Store.resize( Chunk.Count );
+        std::iota( Store.Ids.begin(), Store.Ids.end(), size_t{ 0 } );
+    }
+
+    Failed.store( false, std::memory_order_relaxed );
+
+    // Not worth waking the pool for a single block
+    if ( Offsets.size() > 2 )
+        Stp->runTask();
+    else
+        decodeBlocks( 0, 1 );
+
+    return !Failed.load( std::memory_order_relaxed );
+}
+
+void TrajectoryReplay::decodeWorker( const size_t ThreadId ) {
+    decodeBlocks( ThreadId, Stp->getThreadCount() );
+}
+
+void TrajectoryReplay::decodeBlocks( const size_t Worker,
+                                     const size_t WorkerCount ) {
+    for ( size_t b = Worker; b + 1 < Offsets.size(); b += WorkerCount ) {
+        if ( !Trajectory::decodeBlock( ChunkData, Offsets, b, Keyframe,
+                                       Format, Quantised ) ) {
+            Failed.store( true, std::memory_order_relaxed );
+            continue;
+        }
+
+        // Straight away, while the block is still in cache
+        if ( Last ) {
+            const size_t Begin = b * Trajectory::BlockSize;
+            const size_t End =
+                std::min( Begin + Trajectory::BlockSize, Quantised.size() );
+
+            Trajectory::dequantise( Quantised, Format, Begin, End,
+                                    Store.PositionX.data(),
+                                    Store.PositionY.data(),
+                                    Store.VelocityX.data(),
+                                    Store.VelocityY.data() );
+        }
+    }
+}
+
+size_t TrajectoryReplay::getChunkEnd( const size_t Frame ) const {
+    return Frame + 1 < Index.size() ? Index[Frame + 1].Offset : DataEnd;
+}
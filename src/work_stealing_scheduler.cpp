@@ -0,0 +1,106 @@
+
+#include <algorithm>
+
+#include "work_stealing_scheduler.hpp"
+
+void WorkStealingScheduler::prepare( const size_t Count,
+                                     const size_t WorkerCount,
+                                     const std::vector< unsigned >& Costs ) {
+    Workers = std::max< size_t >( WorkerCount, 1 );
+
+    if ( QueueCapacity < Workers ) {
+        Queues = std::make_unique< Queue[] >( Workers );
+        QueueCapacity = Workers;
+    }
+
+    const size_t ChunkCount = std::min( Count, Workers * ChunksPerWorker );
+
+    ChunkStart.resize( ChunkCount + 1 );
+    ChunkStart.front() = 0;
+    ChunkStart.back() = Count;
+
+    if ( Costs.size() == Count && ChunkCount > 1 ) {
+        CostPrefix.resize( Count + 1 );
+        CostPrefix[0] = 0;
+
+        for ( size_t i = 0; i < Count; ++i ) {
+            CostPrefix[i + 1] = CostPrefix[i] + Costs[i];
+        }
+
+        const uint64_t Total = CostPrefix.back();
+
+        // Cut where the running cost crosses each equal share
+        for ( size_t c = 1; c < ChunkCount; ++c ) {
+            const uint64_t Target = Total * c / ChunkCount;
+
+            const size_t Cut = static_cast< size_t >(
+                std::lower_bound( CostPrefix.begin(), CostPrefix.end(),
+                                  Target ) -
+                CostPrefix.begin() );
+
+            ChunkStart[c] = std::clamp( Cut, ChunkStart[c - 1], Count );
+        }
+    } else {
+        for ( size_t c = 1; c < ChunkCount; ++c ) {
+            ChunkStart[c] = Count * c / ChunkCount;
+        }
+    }
+
+    // Chunks cost the same, so an equal number goes to every worker
+    for ( size_t w = 0; w < Workers; ++w ) {
+        const unsigned Begin =
+            static_cast< unsigned >( ChunkCount * w / Workers );
+        const unsigned End =
+            static_cast< unsigned >( ChunkCount * ( w + 1 ) / Workers );
+
+        Queues[w].Range.store( pack( Begin, End ), std::memory_order_relaxed );
+    }
+
+    Steals.store( 0, std::memory_order_relaxed );
+}
+
+bool WorkStealingScheduler::pop( const size_t Worker, unsigned& Chunk ) {
+    auto& Range = Queues[Worker].Range;
+    uint64_t Current = Range.load( std::memory_order_relaxed );
+
+    while ( begin( Current ) < end( Current ) ) {
+        if ( Range.compare_exchange_weak(
+                 Current, pack( begin( Current ) + 1, end( Current ) ),
+                 std::memory_order_acq_rel, std::memory_order_relaxed ) ) {
+            Chunk = begin( Current );
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool WorkStealingScheduler::steal( const size_t Worker, unsigned& Chunk ) {
+    for ( size_t k = 1; k < Workers; ++k ) {
+        auto& Range = Queues[( Worker + k ) % Workers].Range;
+        uint64_t Current = Range.load( std::memory_order_relaxed );
+
+        while ( begin( Current ) < end( Current ) ) {
+            // Take the back half, rounded up so a single chunk can go too
+            const unsigned Taken = ( end( Current ) - begin( Current ) + 1 ) / 2;
+            const unsigned Cut = end( Current ) - Taken;
+
+            if ( !Range.compare_exchange_weak(
+                     Current, pack( begin( Current ), Cut ),
+                     std::memory_order_acq_rel, std::memory_order_relaxed ) )
+                continue;
+
+            Chunk = Cut;
+
+            // Our own queue is empty, nobody else can be touching it
+            if ( Taken > 1 )
+                Queues[Worker].Range.store( pack( Cut + 1, end( Current ) ),
+                                            std::memory_order_release );
+
+            Steals.fetch_add( 1, std::memory_order_relaxed );
+            return true;
+        }
+    }
+
+    return false;
+}
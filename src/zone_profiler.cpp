@@ -0,0 +1,97 @@
+
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include "zone_profiler.hpp"
+
+#include <fmt/core.h>
+#include "trace.hpp"
+
+namespace ZoneProfiler {
+
+namespace {
+
+struct Registry {
+    std::mutex Mutex;
+    std::vector< std::unique_ptr< ZoneBuffer > > Buffers;
+};
+
+Registry& getRegistry() {
+    static Registry Instance;
+    return Instance;
+}
+
+} // namespace
+
+ZoneBuffer& getThreadBuffer() {
+    static thread_local ZoneBuffer* Buffer = nullptr;
+    if ( Buffer != nullptr ) return *Buffer;
+
+    Registry& Threads = getRegistry();
+    std::lock_guard< std::mutex > Lock( Threads.Mutex );
+
+    Threads.Buffers.push_back( std::make_unique< ZoneBuffer >() );
+    Buffer = Threads.Buffers.back().get();
+    Buffer->Name = fmt::format( "Thread {}", Threads.Buffers.size() - 1 );
+
+    return *Buffer;
+}
+
+void setThreadName( std::string Name ) {
+    ZoneBuffer& Buffer = getThreadBuffer();
+
+    std::lock_guard< std::mutex > Lock( getRegistry().Mutex );
+    Buffer.Name = std::move( Name );
+}
+
+bool exportChromeTrace( const std::string& Path ) {
+    std::ofstream File( Path, std::ios::trunc );
+
+    if ( !File ) {
+        Trace::message( fmt::format( "{:>24}: could not open {}",
+                                     "Zone trace", Path ) );
+        return false;
+    }
+
+    Registry& Threads = getRegistry();
+    std::lock_guard< std::mutex > Lock( Threads.Mutex );
+
+    size_t Events = 0;
+    size_t Dropped = 0;
+    bool First = true;
+
+    File << "{\"traceEvents\":[\n";
+
+    for ( size_t t = 0; t < Threads.Buffers.size(); ++t ) {
+        ZoneBuffer& Buffer = *Threads.Buffers[t];
+
+        File << ( First ? "" : ",\n" )
+             << fmt::format( "{{\"name\":\"thread_name\",\"ph\":\"M\","
+                             "\"pid\":0,\"tid\":{},"
+                             "\"args\":{{\"name\":\"{}\"}}}}",
+                             t, Buffer.Name );
+        First = false;
+
+        // Chrome wants microseconds
+        Buffer.drain( [&]( const ZoneEvent& Event ) {
+            File << fmt::format( ",\n{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":0,"
+                                 "\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                                 Event.Name, t, Event.Begin * 1e-3,
+                                 ( Event.End - Event.Begin ) * 1e-3 );
+            Events += 1;
+        } );
+
+        Dropped += Buffer.takeDropped();
+    }
+
+    File << "\n]}\n";
+
+    Trace::message( fmt::format(
+        "{:>24}: {} zones from {} threads to {}, {} dropped", "Zone trace",
+        Events, Threads.Buffers.size(), Path, Dropped ) );
+
+    return static_cast< bool >( File );
+}
+
+} // namespace ZoneProfiler
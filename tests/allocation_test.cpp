@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <string>
+
+#include "raylib.h"
+
+#include <fmt/core.h>
+
+#include "allocation_counter.hpp"
+#include "boid_manager.hpp"
+
+#include "check.hpp"
+
+// Once warmed up, a tick must not touch the heap on any backend
+
+namespace {
+
+constexpr size_t WarmupTicks = 60;
+constexpr size_t MeasuredTicks = 200;
+
+using UpdateFunction = void ( BoidManager::* )();
+
+void expectNoAllocations( const std::string& Name,
+                          const NeighbourBackend Backend,
+                          const UpdateFunction Update,
+                          const bool ParallelBuild,
+                          const size_t SortInterval = 0 ) {
+    BoidManager Manager( Vector2{ 1280.f, 720.f }, 4000, 7 );
+    Manager.setNeighbourBackend( Backend );
+    Manager.setParallelTreeBuild( ParallelBuild );
+    Manager.setSortInterval( SortInterval );
+
+    for ( size_t t = 0; t < WarmupTicks; ++t ) {
+        ( Manager.*Update )();
+    }
+
+    const uint64_t Before = AllocationCounter::getAllocations();
+    uint64_t Worst = 0;
+
+    for ( size_t t = 0; t < MeasuredTicks; ++t ) {
+        ( Manager.*Update )();
+        Worst = std::max( Worst, Manager.getTickStats().Allocations.value() );
+    }
+
+    const uint64_t Total = AllocationCounter::getAllocations() - Before;
+
+    Check::expect( Total == 0,
+                   fmt::format( "{}: {} allocations over {} ticks, at most {} "
+                                "in one tick",
+                                Name, Total, MeasuredTicks, Worst ) );
+}
+
+} // namespace
+
+int main() {
+    if ( !AllocationCounter::isEnabled() ) {
+        fmt::print( "built without BOIDS_COUNT_ALLOCATIONS, skipped\n" );
+        return Check::Skipped;
+    }
+
+    expectNoAllocations( "quadtree, updateTree", B_Quadtree,
+                         &BoidManager::updateTree, false );
+    expectNoAllocations( "quadtree, updateTreeThread", B_Quadtree,
+                         &BoidManager::updateTreeThread, false );
+    expectNoAllocations( "quadtree, parallel build", B_Quadtree,
+                         &BoidManager::updateTreeThread, true );
+    expectNoAllocations( "quadtree, sorted every 10 ticks", B_Quadtree,
+                         &BoidManager::updateTreeThread, false, 10 );
+    expectNoAllocations( "grid, updateTree", B_CellGrid,
+                         &BoidManager::updateTree, false );
+    expectNoAllocations( "grid, updateTreeThread", B_CellGrid,
+                         &BoidManager::updateTreeThread, false );
+
+    return Check::finish();
+}
@@ -0,0 +1,66 @@
+#include <random>
+#include <string>
+
+#include "raylib.h"
+
+#include <fmt/core.h>
+
+#include "boid_store.hpp"
+#include "quadtree.hpp"
+
+#include "check.hpp"
+
+// The Barnes-Hut walk must never fold the boid being steered into an
+// aggregate. In a cluster tighter than the flocking radius every other boid
+// is a neighbour, so each boid has to count exactly Count - 1 of them at any
+// theta.
+
+namespace {
+
+constexpr float LocalSize = 25.f;
+
+void testCluster( const size_t Count, const float Spread, const float Theta,
+                  std::mt19937& Rng ) {
+    std::uniform_real_distribution< float > Offset( 0.f, Spread );
+    std::uniform_real_distribution< float > Velocity( -3.f, 3.f );
+
+    BoidStore Store;
+    for ( size_t i = 0; i < Count; ++i ) {
+        Store.push( Vector2{ 200.f + Offset( Rng ), 200.f + Offset( Rng ) },
+                    Vector2{ Velocity( Rng ), Velocity( Rng ) }, i );
+    }
+
+    Quadtree Tree;
+    Tree.setTheta( Theta );
+    Tree.build( Store );
+    Tree.computeAggregates( Store );
+
+    size_t Wrong = 0;
+    for ( size_t i = 0; i < Count; ++i ) {
+        const BoidsUpdateValues Values =
+            Tree.calculateVelocity( Store, i, LocalSize );
+
+        if ( Values.Count != Count - 1 ) Wrong += 1;
+    }
+
+    Check::expect( Wrong == 0,
+                   fmt::format( "{} boids in {:.0f} px at theta {:.1f}: {} "
+                                "counted the wrong neighbours",
+                                Count, Spread, Theta, Wrong ) );
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 Rng( 3 );
+
+    for ( const float Theta : { 0.5f, 1.f, 1.5f } ) {
+        for ( const size_t Count : { 2, 3, 16, 200 } ) {
+            for ( const float Spread : { 2.f, 10.f } ) {
+                testCluster( Count, Spread, Theta, Rng );
+            }
+        }
+    }
+
+    return Check::finish();
+}
@@ -0,0 +1,36 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+#pragma once
+
+#include <string_view>
+
+#include <fmt/core.h>
+
+// Minimal assertions for the ctest executables, which exit nonzero when any
+// check failed
+namespace Check {
+
+inline int Failures = 0;
+
+inline bool expect( const bool Condition, const std::string_view What ) {
+    if ( !Condition ) {
+        Failures += 1;
+        fmt::print( "FAILED: {}\n", What );
+    }
+
+    return Condition;
+}
+
+inline int finish() {
+    if ( Failures > 0 ) fmt::print( "{} checks failed\n", Failures );
+
+    return Failures > 0 ? 1 : 0;
+}
+
+// Return code registered as SKIP_RETURN_CODE for tests that cannot run in
+// this configuration
+constexpr int Skipped = 77;
+
+} // namespace Check
+
+#endif
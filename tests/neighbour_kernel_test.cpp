@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "raylib.h"
+
+#include <fmt/core.h>
+
+#include "boid.hpp"
+#include "boid_store.hpp"
+#include "neighbour_kernel.hpp"
+
+#include "check.hpp"
+
+// Runs every instruction set the CPU supports against BoidsUpdateValues::add
+// on the same candidates
+
+namespace {
+
+constexpr float Radius = 25.f;
+constexpr float AvoidDistance = 10.f;
+
+// Reference sums, with the magnitude of everything that went into each one
+// so the tolerance scales with what the lanes added up
+struct Reference {
+    BoidsUpdateValues Values;
+    float Velocity = 0.f;
+    float Position = 0.f;
+    float Avoid = 0.f;
+};
+
+Reference accumulateReference( const BoidStore& Store,
+                               const std::vector< size_t >& Indices,
+                               const size_t Exclude,
+                               const Vector2& Position ) {
+    Reference Result;
+
+    for ( const size_t j : Indices ) {
+        if ( j == Exclude ) continue;
+
+        const Vector2 Other = Store.getPosition( j );
+        const float Dx = Other.x - Position.x;
+        const float Dy = Other.y - Position.y;
+        const float DistanceSqr = Dx * Dx + Dy * Dy;
+
+        // The kernel's test, both sides agree on who is a neighbour
+        if ( DistanceSqr >= Radius * Radius ) continue;
+
+        const float Distance = std::sqrt( DistanceSqr );
+        const Vector2 AvoidBefore = Result.Values.AvgAvoid;
+
+        Result.Values.add( Position, Other, Store.getVelocity( j ), Distance,
+                           AvoidDistance );
+
+        Result.Velocity += std::fabs( Store.VelocityX[j] ) +
+                           std::fabs( Store.VelocityY[j] );
+        Result.Position += std::fabs( Other.x ) + std::fabs( Other.y );
+        Result.Avoid +=
+            std::fabs( Result.Values.AvgAvoid.x - AvoidBefore.x ) +
+            std::fabs( Result.Values.AvgAvoid.y - AvoidBefore.y );
+    }
+
+    return Result;
+}
+
+bool near( const float Got, const float Want, const float Magnitude ) {
+    return std::fabs( Got - Want ) <= 1e-5f * Magnitude + 1e-5f;
+}
+
+void compare( const BoidsUpdateValues& Got, const Reference& Want,
+              const std::string& What ) {
+    Check::expect( Got.Count == Want.Values.Count, What + ": count" );
+    Check::expect( near( Got.AvgVelocity.x, Want.Values.AvgVelocity.x,
+                         Want.Velocity ) &&
+                       near( Got.AvgVelocity.y, Want.Values.AvgVelocity.y,
+                             Want.Velocity ),
+                   What + ": velocity" );
+    Check::expect( near( Got.AvgPosition.x, Want.Values.AvgPosition.x,
+                         Want.Position ) &&
+                       near( Got.AvgPosition.y, Want.Values.AvgPosition.y,
+                             Want.Position ),
+                   What + ": position" );
+    Check::expect(
+        near( Got.AvgAvoid.x, Want.Values.AvgAvoid.x, Want.Avoid ) &&
+            near( Got.AvgAvoid.y, Want.Values.AvgAvoid.y, Want.Avoid ),
+        What + ": avoidance" );
+}
+
+// Candidates around Center, with the cases the lanes get wrong most easily.
+// Boids almost on top of Center push a thousand times harder than the rest
+// and would hide errors in the others within the tolerance, so they are
+// optional.
+BoidStore makeCandidates( const Vector2& Center, const size_t Count,
+                          const bool Touching, std::mt19937& Rng ) {
+    std::uniform_real_distribution< float > Offset( -2.f * Radius,
+                                                    2.f * Radius );
+    std::uniform_real_distribution< float > Velocity( -7.f, 7.f );
+    std::uniform_real_distribution< float > Angle( 0.f, 6.2831853f );
+
+    BoidStore Store;
+    Store.reserve( Count );
+
+    for ( size_t i = 0; i < Count; ++i ) {
+        Vector2 Position{ Center.x + Offset( Rng ), Center.y + Offset( Rng ) };
+
+        // Place some boids at distances on the edges of each test
+        const float Theta = Angle( Rng );
+        const auto around = [&]( const float Distance ) {
+            return Vector2{ Center.x + std::cos( Theta ) * Distance,
+                            Center.y + std::sin( Theta ) * Distance };
+        };
+
+        switch ( i % 8 ) {
+        case 1:
+            // Coincident with the query
+            Position = Center;
+            break;
+        case 3:
+            Position = around( Radius * 1.001f );
+            break;
+        case 5:
+            Position = around( Radius * 0.999f );
+            break;
+        case 7:
+            // Below the 0.001 clamp of the separation term
+            if ( Touching ) Position = around( 0.0005f );
+            break;
+        default:
+            break;
+        }
+
+        Store.push( Position, Vector2{ Velocity( Rng ), Velocity( Rng ) }, i );
+    }
+
+    return Store;
+}
+
+void testCandidates( const std::string& Name, const size_t Length,
+                     const bool Touching, std::mt19937& Rng ) {
+    const Vector2 Center{ 400.f, 300.f };
+    const BoidStore Store = makeCandidates( Center, Length, Touching, Rng );
+
+    std::vector< size_t > All( Length );
+    std::iota( All.begin(), All.end(), 0 );
+
+    // Contiguous range, which counts the boid at Center itself
+    BoidsUpdateValues Range;
+    NeighbourKernel::accumulate( Store, 0, Length, Center, Radius,
+                                 AvoidDistance, Range );
+    compare( Range, accumulateReference( Store, All, Length, Center ),
+             fmt::format( "{} range of {}", Name, Length ) );
+
+    // Scattered indices in blocks of 64, leaving one boid out
+    std::vector< size_t > Shuffled = All;
+    std::shuffle( Shuffled.begin(), Shuffled.end(), Rng );
+    const size_t Exclude = Length > 0 ? Shuffled.front() : 0;
+
+    BoidsUpdateValues Listed;
+    NeighbourKernel::accumulate( Store, Shuffled.data(), Shuffled.size(),
+                                 Exclude, Center, Radius, AvoidDistance,
+                                 Listed );
+    compare( Listed, accumulateReference( Store, Shuffled, Exclude, Center ),
+             fmt::format( "{} list of {}", Name, Length ) );
+}
+
+void testIsa( const NeighbourKernel::Isa Use ) {
+    NeighbourKernel::setIsa( Use );
+    const std::string Name = NeighbourKernel::getIsaName( Use );
+
+    if ( !Check::expect( NeighbourKernel::getIsa() == Use,
+                         Name + ": setIsa did not take" ) )
+        return;
+
+    std::mt19937 Rng( 42 );
+
+    // Lengths around every lane width, so the tails get covered
+    const size_t Lengths[] = { 0,  1,  3,  4,  5,  7,   8,   9,  15,
+                               16, 17, 31, 33, 63, 64, 65, 129, 1000 };
+
+    for ( const size_t Length : Lengths ) {
+        for ( const bool Touching : { false, true } ) {
+            testCandidates( Name, Length, Touching, Rng );
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    const NeighbourKernel::Isa Supported = NeighbourKernel::getSupportedIsa();
+
+    for ( int i = NeighbourKernel::I_Scalar; i <= NeighbourKernel::I_Avx512;
+          ++i ) {
+        const auto Use = static_cast< NeighbourKernel::Isa >( i );
+
+        if ( Use > Supported ) {
+            fmt::print( "{}: not supported by this CPU, skipped\n",
+                        NeighbourKernel::getIsaName( Use ) );
+            continue;
+        }
+
+        testIsa( Use );
+    }
+
+    NeighbourKernel::setIsa( Supported );
+
+    return Check::finish();
+}
@@ -0,0 +1,130 @@
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "raylib.h"
+
+#include <fmt/core.h>
+
+#include "boid_manager.hpp"
+#include "quadtree.hpp"
+
+#include "check.hpp"
+
+// The parallel quadtree build has to lay out exactly the nodes the serial
+// build does, whatever the worker count
+
+namespace {
+
+bool sameNodes( const Quadtree& A, const Quadtree& B ) {
+    const std::vector< Quad >& NodesA = A.getNodes();
+    const std::vector< Quad >& NodesB = B.getNodes();
+
+    return NodesA.size() == NodesB.size() &&
+           std::memcmp( NodesA.data(), NodesB.data(),
+                        NodesA.size() * sizeof( Quad ) ) == 0;
+}
+
+template < typename TCallback >
+void runWorkers( const size_t WorkerCount, TCallback&& Callback ) {
+    std::vector< std::thread > Workers;
+
+    for ( size_t w = 0; w < WorkerCount; ++w ) {
+        Workers.emplace_back( [&Callback, w]() { Callback( w ); } );
+    }
+
+    for ( std::thread& Worker : Workers ) {
+        Worker.join();
+    }
+}
+
+void buildParallel( Quadtree& Tree, const BoidStore& Store,
+                    const size_t WorkerCount ) {
+    Tree.beginBuild( Store, WorkerCount );
+    runWorkers( WorkerCount, [&]( const size_t Worker ) {
+        Tree.buildTasks( Worker, WorkerCount );
+    } );
+
+    Tree.allocateTasks();
+    runWorkers( WorkerCount, [&]( const size_t Worker ) {
+        Tree.stitchTasks( Worker, WorkerCount );
+    } );
+}
+
+void testStore( const std::string& Name, const BoidStore& Store ) {
+    Quadtree Serial;
+    Serial.build( Store );
+
+    for ( const size_t WorkerCount : { 1, 2, 8 } ) {
+        Quadtree Parallel;
+
+        // Twice, the second time with warm worker caches
+        for ( int Pass = 0; Pass < 2; ++Pass ) {
+            buildParallel( Parallel, Store, WorkerCount );
+
+            Check::expect( sameNodes( Serial, Parallel ),
+                           fmt::format( "{}, {} workers, pass {}", Name,
+                                        WorkerCount, Pass ) );
+        }
+    }
+}
+
+// Whole runs with the serial and the parallel build step identically
+void testManagers() {
+    BoidManager Serial( Vector2{ 1280.f, 720.f }, 3000, 5 );
+    BoidManager Parallel( Vector2{ 1280.f, 720.f }, 3000, 5 );
+    Parallel.setParallelTreeBuild( true );
+
+    for ( int t = 0; t < 40; ++t ) {
+        Serial.updateTree();
+        Parallel.updateTree();
+
+        if ( !Check::expect( sameNodes( *Serial.getQuadtree(),
+                                        *Parallel.getQuadtree() ),
+                             fmt::format( "manager tree at tick {}", t ) ) )
+            return;
+    }
+
+    const BoidStore& A = Serial.getStore();
+    const BoidStore& B = Parallel.getStore();
+    const size_t Bytes = A.size() * sizeof( float );
+
+    Check::expect( A.size() == B.size() &&
+                       std::memcmp( A.PositionX.data(), B.PositionX.data(),
+                                    Bytes ) == 0 &&
+                       std::memcmp( A.PositionY.data(), B.PositionY.data(),
+                                    Bytes ) == 0,
+                   "manager positions after 40 ticks" );
+}
+
+} // namespace
+
+int main() {
+    // A fresh random flock, then the same one clustered by flocking
+    BoidManager Manager( Vector2{ 1280.f, 720.f }, 5000, 3 );
+    testStore( "random flock", Manager.getStore() );
+
+    for ( int t = 0; t < 100; ++t ) {
+        Manager.updateTree();
+    }
+    testStore( "clustered flock", Manager.getStore() );
+
+    // Too few boids for any task, and the same spot many times over
+    BoidStore Small;
+    Small.push( Vector2{ 10.f, 10.f }, Vector2{ 0.f, 0.f }, 0 );
+    Small.push( Vector2{ 20.f, 15.f }, Vector2{ 0.f, 0.f }, 1 );
+    testStore( "two boids", Small );
+
+    BoidStore Stacked;
+    for ( size_t i = 0; i < 64; ++i ) {
+        const float Offset = i < 32 ? 0.f : static_cast< float >( i );
+        Stacked.push( Vector2{ 100.f + Offset, 100.f }, Vector2{ 0.f, 0.f },
+                      i );
+    }
+    testStore( "stacked boids", Stacked );
+
+    testManagers();
+
+    return Check::finish();
+}
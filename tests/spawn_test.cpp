@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "raylib.h"
+
+#include <fmt/core.h>
+
+#include "boid_manager.hpp"
+#include "quadtree.hpp"
+
+#include "check.hpp"
+
+// Spawns and despawns between ticks in every index mode, checking the id to
+// slot lookup and the ids held by the quadtree after each batch
+
+namespace {
+
+constexpr Vector2 Bounds{ 1280.f, 720.f };
+
+struct Mode {
+    std::string Name;
+    bool Threaded = false;
+    bool Incremental = false;
+    float VerletSkin = 0.f;
+    bool Grid = false;
+};
+
+// Ids of the boids in the quadtree's leaves, empty when a slot appears twice
+// or is past the end of the store
+std::vector< size_t > treeIds( const BoidManager& Manager, bool& Valid ) {
+    const BoidStore& Store = Manager.getStore();
+    std::vector< size_t > Ids;
+    std::vector< bool > Seen( Store.size(), false );
+
+    for ( const Quad& Node : Manager.getQuadtree()->getNodes() ) {
+        if ( Node.hasChildren() || Node.BodyId < 0 ) continue;
+
+        const size_t Slot = static_cast< size_t >( Node.BodyId );
+        if ( Slot >= Store.size() || Seen[Slot] ) {
+            Valid = false;
+            return {};
+        }
+
+        Seen[Slot] = true;
+        Ids.push_back( Store.Ids[Slot] );
+    }
+
+    std::sort( Ids.begin(), Ids.end() );
+    return Ids;
+}
+
+void forget( std::vector< size_t >& Ids, const size_t Id ) {
+    Ids.erase( std::remove( Ids.begin(), Ids.end(), Id ), Ids.end() );
+}
+
+bool slotsMatch( const BoidManager& Manager,
+                 const std::vector< size_t >& Alive ) {
+    const BoidStore& Store = Manager.getStore();
+    if ( Store.size() != Alive.size() ) return false;
+
+    for ( const size_t Id : Alive ) {
+        const std::optional< size_t > Slot = Manager.findSlot( Id );
+        if ( !Slot || *Slot >= Store.size() || Store.Ids[*Slot] != Id )
+            return false;
+    }
+
+    return true;
+}
+
+void testMode( const Mode& Use ) {
+    BoidManager Manager( Bounds, 2000, 11 );
+
+    if ( Use.Incremental ) Manager.setIncrementalTree( true, 15 );
+    if ( Use.VerletSkin > 0.f ) Manager.setVerletLists( true, Use.VerletSkin );
+    if ( Use.Grid ) Manager.setNeighbourBackend( B_CellGrid );
+
+    const auto tick = [&]() {
+        if ( Use.Threaded )
+            Manager.updateTreeThread();
+        else
+            Manager.updateTree();
+    };
+
+    std::vector< size_t > Alive( Manager.getCount() );
+    for ( size_t Slot = 0; Slot < Alive.size(); ++Slot ) {
+        Alive[Slot] = Manager.getStore().Ids[Slot];
+    }
+
+    std::mt19937 Rng( 5 );
+    std::uniform_real_distribution< float > X( 0.f, Bounds.x );
+    std::uniform_real_distribution< float > Y( 0.f, Bounds.y );
+    std::uniform_real_distribution< float > Speed( -3.f, 3.f );
+
+    for ( int t = 0; t < 5; ++t ) {
+        tick();
+    }
+
+    for ( int Round = 0; Round < 60; ++Round ) {
+        const std::string Where =
+            fmt::format( "{}, round {}", Use.Name, Round );
+
+        bool Valid = true;
+        std::vector< size_t > Expected =
+            Use.Grid ? std::vector< size_t >{} : treeIds( Manager, Valid );
+
+        // Random boids, the boid in the last slot, and one spawned this round
+        std::vector< size_t > Gone;
+        for ( int d = 0; d < 25 && Alive.size() > 1; ++d ) {
+            const size_t Pick =
+                d == 0 ? Manager.getStore().Ids[Manager.getCount() - 1]
+                       : Alive[Rng() % Alive.size()];
+
+            if ( !Check::expect( Manager.despawn( Pick ),
+                                 Where + ": despawn of a live id failed" ) )
+                return;
+
+            forget( Alive, Pick );
+            forget( Expected, Pick );
+            Gone.push_back( Pick );
+        }
+
+        for ( int s = 0; s < 25; ++s ) {
+            const Vector2 Position{ X( Rng ), Y( Rng ) };
+            const bool InTree = Manager.getQuadtree()->contains( Position );
+
+            const Vector2 Velocity{ Speed( Rng ), Speed( Rng ) };
+            const size_t Id = Manager.spawn( Position, Velocity );
+
+            if ( s == 0 ) {
+                Manager.despawn( Id );
+                Gone.push_back( Id );
+                continue;
+            }
+
+            Alive.push_back( Id );
+            if ( InTree ) Expected.push_back( Id );
+        }
+
+        for ( const size_t Id : Gone ) {
+            if ( std::find( Alive.begin(), Alive.end(), Id ) != Alive.end() )
+                continue;
+
+            Check::expect( !Manager.findSlot( Id ),
+                           Where + ": despawned id still has a slot" );
+            Check::expect( !Manager.despawn( Id ),
+                           Where + ": despawned id despawned twice" );
+        }
+
+        if ( !Check::expect( slotsMatch( Manager, Alive ),
+                             Where + ": id to slot lookup" ) )
+            return;
+
+        if ( !Use.Grid ) {
+            std::sort( Expected.begin(), Expected.end() );
+            const std::vector< size_t > Held = treeIds( Manager, Valid );
+
+            if ( !Check::expect( Valid && Held == Expected,
+                                 Where + ": quadtree contents" ) )
+                return;
+        }
+
+        tick();
+    }
+}
+
+} // namespace
+
+int main() {
+    const Mode Modes[] = {
+        { "full rebuild" },
+        { "threaded", true },
+        { "incremental", false, true },
+        { "incremental, threaded", true, true },
+        { "verlet", false, false, 8.f },
+        { "incremental verlet", true, true, 8.f },
+        { "grid", true, false, 0.f, true },
+    };
+
+    for ( const Mode& Use : Modes ) {
+        testMode( Use );
+    }
+
+    return Check::finish();
+}